@@ -149,7 +149,7 @@ public:
 
 		// ranges
 		if (b.nRanges > 0) {
-			uint32 *pranges = (uint32*)(f.getBuffer() + b.ofsRanges);
+			const uint32 *pranges = (const uint32*)(f.getConstBuffer() + b.ofsRanges);
 			for (size_t i=0, k=0; i<b.nRanges; i++) {
 				AnimRange r;
 				r.first = pranges[k++];
@@ -165,11 +165,11 @@ public:
 
 		// times
 		assert(b.nTimes == b.nKeys);
-		uint32 *ptimes = (uint32*)(f.getBuffer() + b.ofsTimes);
+		const uint32 *ptimes = (const uint32*)(f.getConstBuffer() + b.ofsTimes);
 		for (size_t i=0; i<b.nTimes; i++) times.push_back(ptimes[i]);
 
 		// keyframes
-		D *keys = (D*)(f.getBuffer() + b.ofsKeys);
+		const D *keys = (const D*)(f.getConstBuffer() + b.ofsKeys);
 		switch (type) {
 			case INTERPOLATION_NONE:
 			case INTERPOLATION_LINEAR:
@@ -0,0 +1,612 @@
+#include "blp.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLP_SSE2
+#include <emmintrin.h>
+#endif
+
+// 565 endpoints are widened by repeating their top bits, the way the GL drivers do
+static inline unsigned int expand5(unsigned int v) { return (v << 3) | (v >> 2); }
+static inline unsigned int expand6(unsigned int v) { return (v << 2) | (v >> 4); }
+
+static inline unsigned int blockSize(GLint format)
+{
+	return (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) ? 16 : 8;
+}
+
+// copies a decoded 4x4 block, clipped to the level
+static void storeBlock(const unsigned char *block, int w, int h, int x, int y, unsigned char *dest)
+{
+	int bw = (w - x < 4) ? w - x : 4;
+	int bh = (h - y < 4) ? h - y : 4;
+	for (int j=0; j<bh; j++)
+		memcpy(dest + (w*(y+j)+x)*4, block + j*16, bw*4);
+}
+
+// per texel and straight from the format description, this is what the fast path is checked against
+static void referenceBlock(GLint format, const unsigned char *src, unsigned char *out)
+{
+	const unsigned char *color = blockSize(format) == 16 ? src + 8 : src;
+	unsigned int c0 = color[0] | (color[1] << 8);
+	unsigned int c1 = color[2] | (color[3] << 8);
+	unsigned int bits = color[4] | (color[5] << 8) | (color[6] << 16) | ((unsigned int)color[7] << 24);
+
+	unsigned int e0[3] = { expand5(c0 >> 11), expand6((c0 >> 5) & 0x3f), expand5(c0 & 0x1f) };
+	unsigned int e1[3] = { expand5(c1 >> 11), expand6((c1 >> 5) & 0x3f), expand5(c1 & 0x1f) };
+
+	// DXT3 and DXT5 colour blocks always interpolate four colours, whatever the endpoint order
+	bool four = c0 > c1 || blockSize(format) == 16;
+
+	unsigned long long alphabits = 0;
+	for (int i=0; i<6; i++)
+		alphabits |= (unsigned long long)src[2+i] << (8*i);
+
+	for (int t=0; t<16; t++) {
+		int index = (bits >> (2*t)) & 3;
+		unsigned int a = 255;
+		for (int c=0; c<3; c++) {
+			unsigned int v;
+			if (index == 0) v = e0[c];
+			else if (index == 1) v = e1[c];
+			else if (four) v = (index == 2) ? (2*e0[c] + e1[c]) / 3 : (e0[c] + 2*e1[c]) / 3;
+			else if (index == 2) v = (e0[c] + e1[c]) / 2;
+			else v = 0;
+			out[t*4+c] = (unsigned char)v;
+		}
+		if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT && index == 3 && c0 <= c1)
+			a = 0;
+
+		if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT) {
+			a = ((src[t/2] >> (4*(t&1))) & 0x0f) * 17;
+		}
+		else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+			unsigned int a0 = src[0], a1 = src[1];
+			unsigned int ai = (unsigned int)(alphabits >> (3*t)) & 7;
+			if (ai == 0) a = a0;
+			else if (ai == 1) a = a1;
+			else if (a0 > a1) a = ((8-ai)*a0 + (ai-1)*a1) / 7;
+			else if (ai == 6) a = 0;
+			else if (ai == 7) a = 255;
+			else a = ((6-ai)*a0 + (ai-1)*a1) / 5;
+		}
+		out[t*4+3] = (unsigned char)a;
+	}
+}
+
+void decompressDXTCReference(GLint format, int w, int h, size_t size, const unsigned char *src, unsigned char *dest)
+{
+	unsigned int bs = blockSize(format);
+	const unsigned char *end = src + size;
+	unsigned char block[64];
+
+	for (int y=0; y<h; y += 4) {
+		for (int x=0; x<w; x += 4) {
+			if ((size_t)(end - src) < bs)
+				return;
+			referenceBlock(format, src, block);
+			storeBlock(block, w, h, x, y, dest);
+			src += bs;
+		}
+	}
+}
+
+#ifdef BLP_SSE2
+
+// the four colours of a block as RGBA words
+static inline void colorPalette(GLint format, unsigned int c0, unsigned int c1, unsigned int *pal)
+{
+	unsigned int r0 = expand5(c0 >> 11), g0 = expand6((c0 >> 5) & 0x3f), b0 = expand5(c0 & 0x1f);
+	unsigned int r1 = expand5(c1 >> 11), g1 = expand6((c1 >> 5) & 0x3f), b1 = expand5(c1 & 0x1f);
+
+	pal[0] = r0 | (g0 << 8) | (b0 << 16) | 0xff000000;
+	pal[1] = r1 | (g1 << 8) | (b1 << 16) | 0xff000000;
+	// only DXT1 has the three colour mode, DXT3 and DXT5 interpolate whatever the endpoint order
+	if (c0 > c1 || blockSize(format) == 16) {
+		pal[2] = (2*r0 + r1) / 3 | ((2*g0 + g1) / 3 << 8) | ((2*b0 + b1) / 3 << 16) | 0xff000000;
+		pal[3] = (r0 + 2*r1) / 3 | ((g0 + 2*g1) / 3 << 8) | ((b0 + 2*b1) / 3 << 16) | 0xff000000;
+	} else {
+		pal[2] = (r0 + r1) / 2 | ((g0 + g1) / 2 << 8) | ((b0 + b1) / 2 << 16) | 0xff000000;
+		pal[3] = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 0 : 0xff000000;
+	}
+}
+
+static inline __m128i selectMask(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// sixteen alpha bytes in texel order moved into the top byte of four rows of texels
+static inline void alphaRows(__m128i alpha, __m128i *rows)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_unpacklo_epi8(zero, alpha);
+	__m128i hi = _mm_unpackhi_epi8(zero, alpha);
+	rows[0] = _mm_unpacklo_epi16(zero, lo);
+	rows[1] = _mm_unpackhi_epi16(zero, lo);
+	rows[2] = _mm_unpacklo_epi16(zero, hi);
+	rows[3] = _mm_unpackhi_epi16(zero, hi);
+}
+
+void decompressDXTC(GLint format, int w, int h, size_t size, const unsigned char *src, unsigned char *dest)
+{
+	unsigned int bs = blockSize(format);
+	const unsigned char *end = src + size;
+	unsigned char block[64];
+
+	// each texel tests its two index bits against these, row by row
+	const __m128i bit0 = _mm_set_epi32(64, 16, 4, 1);
+	const __m128i bit1 = _mm_set_epi32(128, 32, 8, 2);
+	const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	for (int y=0; y<h; y += 4) {
+		for (int x=0; x<w; x += 4) {
+			if ((size_t)(end - src) < bs)
+				return;
+
+			const unsigned char *color = (bs == 16) ? src + 8 : src;
+			unsigned int c0 = color[0] | (color[1] << 8);
+			unsigned int c1 = color[2] | (color[3] << 8);
+			unsigned int bits = color[4] | (color[5] << 8) | (color[6] << 16) | ((unsigned int)color[7] << 24);
+
+			unsigned int pal[4];
+			colorPalette(format, c0, c1, pal);
+			__m128i p0 = _mm_set1_epi32(pal[0]);
+			__m128i p1 = _mm_set1_epi32(pal[1]);
+			__m128i p2 = _mm_set1_epi32(pal[2]);
+			__m128i p3 = _mm_set1_epi32(pal[3]);
+
+			__m128i alpha[4];
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT) {
+				// nibbles in texel order, widened to bytes by repeating them
+				__m128i packed = _mm_loadl_epi64((const __m128i*)src);
+				__m128i lo = _mm_and_si128(packed, nibble);
+				__m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+				__m128i a = _mm_unpacklo_epi8(lo, hi);
+				alphaRows(_mm_or_si128(a, _mm_slli_epi16(a, 4)), alpha);
+			}
+			else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				// eight interpolated values looked up by the 3 bit indices
+				unsigned int a0 = src[0], a1 = src[1];
+				unsigned char apal[8];
+				apal[0] = (unsigned char)a0;
+				apal[1] = (unsigned char)a1;
+				if (a0 > a1) {
+					for (unsigned int i=2; i<8; i++)
+						apal[i] = (unsigned char)(((8-i)*a0 + (i-1)*a1) / 7);
+				} else {
+					for (unsigned int i=2; i<6; i++)
+						apal[i] = (unsigned char)(((6-i)*a0 + (i-1)*a1) / 5);
+					apal[6] = 0;
+					apal[7] = 255;
+				}
+				unsigned int lo = src[2] | (src[3] << 8) | (src[4] << 16);
+				unsigned int hi = src[5] | (src[6] << 8) | (src[7] << 16);
+				unsigned char a[16];
+				for (int t=0; t<8; t++) {
+					a[t] = apal[(lo >> (3*t)) & 7];
+					a[t+8] = apal[(hi >> (3*t)) & 7];
+				}
+				alphaRows(_mm_loadu_si128((const __m128i*)a), alpha);
+			}
+
+			bool full = (x + 4 <= w) && (y + 4 <= h);
+			for (int j=0; j<4; j++) {
+				__m128i row = _mm_set1_epi32((bits >> (8*j)) & 0xff);
+				__m128i lo = _mm_cmpeq_epi32(_mm_and_si128(row, bit0), bit0);
+				__m128i hi = _mm_cmpeq_epi32(_mm_and_si128(row, bit1), bit1);
+				__m128i texels = selectMask(hi, selectMask(lo, p3, p2), selectMask(lo, p1, p0));
+				if (bs == 16)
+					texels = _mm_or_si128(_mm_and_si128(texels, rgbMask), alpha[j]);
+
+				if (full)
+					_mm_storeu_si128((__m128i*)(dest + (w*(y+j)+x)*4), texels);
+				else
+					_mm_storeu_si128((__m128i*)(block + j*16), texels);
+			}
+			if (!full)
+				storeBlock(block, w, h, x, y, dest);
+			src += bs;
+		}
+	}
+}
+
+#else
+
+void decompressDXTC(GLint format, int w, int h, size_t size, const unsigned char *src, unsigned char *dest)
+{
+	decompressDXTCReference(format, w, h, size, src, dest);
+}
+
+#endif
+
+// the palette holds BGRA words, the texels want RGB with the alpha taken from the alpha bits
+static inline unsigned int swizzle(unsigned int k)
+{
+	return ((k&0x00FF0000)>>16) | ((k&0x0000FF00)) | ((k& 0x000000FF)<<16);
+}
+
+void expandPaletteReference(const unsigned char *palette, int alphabits, int w, int h, const unsigned char *src, unsigned char *dest)
+{
+	int cnt = 0;
+	unsigned int *p = (unsigned int*)dest;
+	const unsigned char *c = src;
+	const unsigned char *a = src + w*h;
+	for (int y=0; y<h; y++) {
+		for (int x=0; x<w; x++) {
+			unsigned int k;
+			memcpy(&k, palette + 4 * *c++, 4);
+			k = swizzle(k);
+			int alpha = 0xff;
+			if (alphabits == 8) {
+				alpha = (*a++);
+			} else if (alphabits == 4) {
+				alpha = ((*a >> cnt) & 0x0f) * 17;
+				cnt += 4;
+				if (cnt == 8) {
+					cnt = 0;
+					a++;
+				}
+			} else if (alphabits == 1) {
+				alpha = (*a & (1 << cnt++)) ? 0xff : 0;
+				if (cnt == 8) {
+					cnt = 0;
+					a++;
+				}
+			}
+
+			k |= alpha << 24;
+			*p++ = k;
+		}
+	}
+}
+
+#ifdef BLP_SSE2
+
+void expandPalette(const unsigned char *palette, int alphabits, int w, int h, const unsigned char *src, unsigned char *dest)
+{
+	// swizzled once per level, opaque unless alpha bits follow
+	unsigned int pal[256];
+	bool alpha = alphabits == 1 || alphabits == 4 || alphabits == 8;
+	for (int i=0; i<256; i++) {
+		unsigned int k;
+		memcpy(&k, palette + 4*i, 4);
+		pal[i] = swizzle(k) | (alpha ? 0 : 0xff000000);
+	}
+
+	const __m128i bits = _mm_set_epi8((char)128, 64, 32, 16, 8, 4, 2, 1, (char)128, 64, 32, 16, 8, 4, 2, 1);
+	const __m128i nibble = _mm_set1_epi8(0x0f);
+
+	// sixteen texels at a time; SSE2 has no gather, so the palette lookups stay scalar and
+	// the alpha of all sixteen is unpacked and merged in registers
+	int n = w*h;
+	int done = 0;
+	const unsigned char *c = src;
+	const unsigned char *a = src + n;
+	for (; done + 16 <= n; done += 16, c += 16) {
+		__m128i texels[4];
+		for (int j=0; j<4; j++)
+			texels[j] = _mm_set_epi32(pal[c[4*j+3]], pal[c[4*j+2]], pal[c[4*j+1]], pal[c[4*j]]);
+
+		if (alpha) {
+			__m128i values;
+			if (alphabits == 8) {
+				values = _mm_loadu_si128((const __m128i*)a);
+				a += 16;
+			} else if (alphabits == 4) {
+				__m128i packed = _mm_loadl_epi64((const __m128i*)a);
+				__m128i lo = _mm_and_si128(packed, nibble);
+				__m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), nibble);
+				values = _mm_unpacklo_epi8(lo, hi);
+				values = _mm_or_si128(values, _mm_slli_epi16(values, 4));
+				a += 8;
+			} else {
+				// each byte tests its own bit of the two mask bytes
+				__m128i mask = _mm_unpacklo_epi64(_mm_set1_epi8((char)a[0]), _mm_set1_epi8((char)a[1]));
+				values = _mm_cmpeq_epi8(_mm_and_si128(mask, bits), bits);
+				a += 2;
+			}
+
+			__m128i rows[4];
+			alphaRows(values, rows);
+			for (int j=0; j<4; j++)
+				texels[j] = _mm_or_si128(texels[j], rows[j]);
+		}
+
+		for (int j=0; j<4; j++)
+			_mm_storeu_si128((__m128i*)(dest + (done + 4*j)*4), texels[j]);
+	}
+
+	// the rest of a level with less than sixteen texels left; alpha is byte aligned here
+	int cnt = 0;
+	unsigned int *p = (unsigned int*)dest + done;
+	for (; done < n; done++) {
+		unsigned int k = pal[*c++];
+		if (alphabits == 8) {
+			k |= (unsigned int)(*a++) << 24;
+		} else if (alphabits == 4) {
+			k |= (unsigned int)(((*a >> cnt) & 0x0f) * 17) << 24;
+			cnt += 4;
+			if (cnt == 8) {
+				cnt = 0;
+				a++;
+			}
+		} else if (alphabits == 1) {
+			k |= (*a & (1 << cnt++)) ? 0xff000000 : 0;
+			if (cnt == 8) {
+				cnt = 0;
+				a++;
+			}
+		}
+		*p++ = k;
+	}
+}
+
+#else
+
+void expandPalette(const unsigned char *palette, int alphabits, int w, int h, const unsigned char *src, unsigned char *dest)
+{
+	expandPaletteReference(palette, alphabits, w, h, src, dest);
+}
+
+#endif
+
+// fast encoder: endpoints from the colour bounding box, its diagonal turned to follow the
+// correlation of red and blue with green and inset a little, then each texel takes the
+// nearest of the colours the decoder will produce
+static void encodeColorBlock(const unsigned char *texels, unsigned char *dest)
+{
+	int lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 };
+	for (int t=0; t<16; t++) {
+		for (int c=0; c<3; c++) {
+			int v = texels[t*4+c];
+			if (v < lo[c]) lo[c] = v;
+			if (v > hi[c]) hi[c] = v;
+			mean[c] += v;
+		}
+	}
+	int covRG = 0, covBG = 0;
+	for (int t=0; t<16; t++) {
+		int g = texels[t*4+1]*16 - mean[1];
+		covRG += (texels[t*4]*16 - mean[0]) * g;
+		covBG += (texels[t*4+2]*16 - mean[2]) * g;
+	}
+	int e0[3], e1[3];
+	for (int c=0; c<3; c++) {
+		int inset = (hi[c] - lo[c]) >> 4;
+		e0[c] = hi[c] - inset;
+		e1[c] = lo[c] + inset;
+	}
+	if (covRG < 0) { int v = e0[0]; e0[0] = e1[0]; e1[0] = v; }
+	if (covBG < 0) { int v = e0[2]; e0[2] = e1[2]; e1[2] = v; }
+
+	unsigned int c0 = ((e0[0] >> 3) << 11) | ((e0[1] >> 2) << 5) | (e0[2] >> 3);
+	unsigned int c1 = ((e1[0] >> 3) << 11) | ((e1[1] >> 2) << 5) | (e1[2] >> 3);
+	if (c0 < c1) { unsigned int v = c0; c0 = c1; c1 = v; }
+
+	unsigned int bits = 0;
+	if (c0 != c1) {
+		// the four colours exactly as the decoder builds them
+		int pal[4][3];
+		pal[0][0] = expand5(c0 >> 11); pal[0][1] = expand6((c0 >> 5) & 0x3f); pal[0][2] = expand5(c0 & 0x1f);
+		pal[1][0] = expand5(c1 >> 11); pal[1][1] = expand6((c1 >> 5) & 0x3f); pal[1][2] = expand5(c1 & 0x1f);
+		for (int c=0; c<3; c++) {
+			pal[2][c] = (2*pal[0][c] + pal[1][c]) / 3;
+			pal[3][c] = (pal[0][c] + 2*pal[1][c]) / 3;
+		}
+		for (int t=0; t<16; t++) {
+			int best = 0, bestError = 0x7fffffff;
+			for (int i=0; i<4; i++) {
+				int dr = texels[t*4] - pal[i][0], dg = texels[t*4+1] - pal[i][1], db = texels[t*4+2] - pal[i][2];
+				int error = dr*dr + dg*dg + db*db;
+				if (error < bestError) {
+					bestError = error;
+					best = i;
+				}
+			}
+			bits |= (unsigned int)best << (2*t);
+		}
+	}
+
+	dest[0] = (unsigned char)c0; dest[1] = (unsigned char)(c0 >> 8);
+	dest[2] = (unsigned char)c1; dest[3] = (unsigned char)(c1 >> 8);
+	for (int i=0; i<4; i++)
+		dest[4+i] = (unsigned char)(bits >> (8*i));
+}
+
+// eight value mode between the extremes, so fully opaque and fully clear stay exact
+static void encodeAlphaBlock(const unsigned char *texels, unsigned char *dest)
+{
+	int a0 = 0, a1 = 255;
+	for (int t=0; t<16; t++) {
+		int a = texels[t*4+3];
+		if (a > a0) a0 = a;
+		if (a < a1) a1 = a;
+	}
+
+	unsigned long long bits = 0;
+	if (a0 != a1) {
+		int pal[8];
+		pal[0] = a0;
+		pal[1] = a1;
+		for (int i=2; i<8; i++)
+			pal[i] = ((8-i)*a0 + (i-1)*a1) / 7;
+		for (int t=0; t<16; t++) {
+			int a = texels[t*4+3];
+			int best = 0, bestError = 256;
+			for (int i=0; i<8; i++) {
+				int error = a > pal[i] ? a - pal[i] : pal[i] - a;
+				if (error < bestError) {
+					bestError = error;
+					best = i;
+				}
+			}
+			bits |= (unsigned long long)best << (3*t);
+		}
+	}
+
+	dest[0] = (unsigned char)a0;
+	dest[1] = (unsigned char)a1;
+	for (int i=0; i<6; i++)
+		dest[2+i] = (unsigned char)(bits >> (8*i));
+}
+
+void compressDXTC(GLint format, int w, int h, const unsigned char *src, unsigned char *dest)
+{
+	unsigned char block[64];
+	for (int y=0; y<h; y += 4) {
+		for (int x=0; x<w; x += 4) {
+			// levels smaller than a block repeat their edge texels
+			for (int j=0; j<4; j++) {
+				int sy = (y+j < h) ? y+j : h-1;
+				for (int i=0; i<4; i++) {
+					int sx = (x+i < w) ? x+i : w-1;
+					memcpy(block + (j*4+i)*4, src + (w*sy+sx)*4, 4);
+				}
+			}
+			if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				encodeAlphaBlock(block, dest);
+				dest += 8;
+			}
+			encodeColorBlock(block, dest);
+			dest += 8;
+		}
+	}
+}
+
+// runs the fast decoder against the reference on every size and times both on 512x512
+template <class Decode>
+static bool compareDecoders(const char *name, Decode decode, int rounds)
+{
+	static const int sizes[][2] = { { 1, 1 }, { 2, 2 }, { 4, 1 }, { 2, 8 }, { 4, 4 }, { 5, 3 }, { 12, 20 }, { 64, 32 }, { 512, 512 } };
+	std::vector<unsigned char> fast(512 * 512 * 4), reference(512 * 512 * 4);
+
+	bool exact = true;
+	for (size_t s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++) {
+		int w = sizes[s][0], h = sizes[s][1];
+		memset(&fast[0], 0xcd, fast.size());
+		memset(&reference[0], 0xcd, reference.size());
+		decode(true, w, h, &fast[0]);
+		decode(false, w, h, &reference[0]);
+		if (memcmp(&fast[0], &reference[0], fast.size())) {
+			printf("  %s %dx%d: decoders differ\n", name, w, h);
+			exact = false;
+		}
+	}
+
+	double seconds[2];
+	for (int r=0; r<2; r++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i=0; i<rounds; i++)
+			decode(r != 0, 512, 512, r ? &fast[0] : &reference[0]);
+		seconds[r] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	double texels = 512.0 * 512.0 * rounds / 1e6;
+	printf("  %-14s %8.1f Mtexel/s, reference %8.1f Mtexel/s\n", name,
+		seconds[1] > 0 ? texels / seconds[1] : 0.0, seconds[0] > 0 ? texels / seconds[0] : 0.0);
+	return exact;
+}
+
+bool benchmarkBLP(int rounds)
+{
+	static const GLint formats[] = {
+		GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT,
+		GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	};
+	static const char *formatNames[] = { "DXT1 RGB", "DXT1 RGBA", "DXT3", "DXT5" };
+	static const int alphas[] = { 0, 1, 4, 8 };
+	static const char *alphaNames[] = { "palette", "palette a1", "palette a4", "palette a8" };
+
+	// random data hits both colour modes, both alpha modes and every index
+	std::vector<unsigned char> src(512 * 512 * 2 + 1024);
+	unsigned int seed = 0x2545f491;
+	for (size_t i=0; i<src.size(); i++) {
+		seed = seed * 1664525 + 1013904223;
+		src[i] = (unsigned char)(seed >> 24);
+	}
+	const unsigned char *palette = &src[512 * 512 * 2];
+
+	bool exact = true;
+	printf("BLP decode benchmark, %d rounds of 512x512, %s\n", rounds,
+#ifdef BLP_SSE2
+		"SSE2"
+#else
+		"no SIMD"
+#endif
+		);
+	for (int f=0; f<4; f++) {
+		GLint format = formats[f];
+		exact &= compareDecoders(formatNames[f], [&](bool fast, int w, int h, unsigned char *dest) {
+			if (fast) decompressDXTC(format, w, h, 512 * 512, &src[0], dest);
+			else decompressDXTCReference(format, w, h, 512 * 512, &src[0], dest);
+		}, rounds);
+	}
+	for (int f=0; f<4; f++) {
+		int alphabits = alphas[f];
+		exact &= compareDecoders(alphaNames[f], [&](bool fast, int w, int h, unsigned char *dest) {
+			if (fast) expandPalette(palette, alphabits, w, h, &src[0], dest);
+			else expandPaletteReference(palette, alphabits, w, h, &src[0], dest);
+		}, rounds);
+	}
+
+	// black to white with c0 < c1 and every index 3: DXT1 gives black from its three colour mode,
+	// DXT3 and DXT5 interpolate to two thirds; both decoders share this rule, so it is checked by value
+	unsigned char known[16], texels[4*4*4];
+	memset(known, 0xff, sizeof(known));
+	known[8] = known[9] = 0;
+	for (int fast=0; fast<2; fast++) {
+		bool ok = true;
+		static const GLint knownFormats[] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT };
+		static const unsigned char knownValues[] = { 0, 170, 170 };
+		for (int f=0; f<3; f++) {
+			const unsigned char *block = knownFormats[f] == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? known + 8 : known;
+			if (fast) decompressDXTC(knownFormats[f], 4, 4, 16, block, texels);
+			else decompressDXTCReference(knownFormats[f], 4, 4, 16, block, texels);
+			ok &= texels[0] == knownValues[f] && texels[60] == knownValues[f] && texels[63] == 255;
+		}
+		if (!ok)
+			printf("  %s decoder: wrong colours when c0 <= c1\n", fast ? "fast" : "reference");
+		exact &= ok;
+	}
+
+	// a smooth image with an alpha ramp, encoded, decoded again and compared
+	std::vector<unsigned char> image(512 * 512 * 4), packed(512 * 512), decoded(512 * 512 * 4);
+	for (int y=0; y<512; y++) {
+		for (int x=0; x<512; x++) {
+			unsigned char *p = &image[(y*512+x)*4];
+			p[0] = (unsigned char)(x / 2);
+			p[1] = (unsigned char)(y / 2);
+			p[2] = (unsigned char)((x + y) / 4);
+			p[3] = (unsigned char)((x ^ y) / 2);
+		}
+	}
+	static const GLint encoded[] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT };
+	for (int f=0; f<2; f++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int i=0; i<rounds; i++)
+			compressDXTC(encoded[f], 512, 512, &image[0], &packed[0]);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		decompressDXTC(encoded[f], 512, 512, packed.size(), &packed[0], &decoded[0]);
+		double error = 0;
+		int channels = f ? 4 : 3;
+		for (size_t i=0; i<image.size(); i++) {
+			if ((int)(i & 3) < channels) {
+				double d = (double)image[i] - decoded[i];
+				error += d * d;
+			}
+		}
+		error /= 512.0 * 512.0 * channels;
+		printf("  encode %-7s %8.1f Mtexel/s, PSNR %.1f dB\n", f ? "DXT5" : "DXT1",
+			seconds > 0 ? 512.0 * 512.0 * rounds / 1e6 / seconds : 0.0, error > 0 ? 10.0 * log10(255.0 * 255.0 / error) : 99.0);
+	}
+
+	printf(exact ? "  all sizes bit-exact\n" : "  MISMATCH\n");
+	return exact;
+}
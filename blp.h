@@ -0,0 +1,31 @@
+#ifndef BLP_H
+#define BLP_H
+
+#include <SDL.h>
+#include <SDL_opengl.h>
+
+#include <cstddef>
+
+// Software decoders for BLP pixel data, used when the GL driver cannot take the compressed
+// or palettized levels as they are. Output is RGBA8, w*h*4 bytes; levels smaller than a
+// block are clipped. The SSE2 paths are bit-exact with the scalar reference decoders.
+
+// DXT1 (RGB and RGBA), DXT3 and DXT5; stops early if src holds fewer than all the blocks
+void decompressDXTC(GLint format, int w, int h, size_t size, const unsigned char *src, unsigned char *dest);
+void decompressDXTCReference(GLint format, int w, int h, size_t size, const unsigned char *src, unsigned char *dest);
+
+// palette indices followed by 0, 1, 4 or 8 alpha bits per texel; palette holds 256 BGRA words
+void expandPalette(const unsigned char *palette, int alphabits, int w, int h, const unsigned char *src, unsigned char *dest);
+void expandPaletteReference(const unsigned char *palette, int alphabits, int w, int h, const unsigned char *src, unsigned char *dest);
+
+// fast DXT1 or DXT5 encoder for RGBA8 levels, for recompressing palettized textures;
+// dest takes ((w+3)/4)*((h+3)/4) blocks of 8 or 16 bytes
+void compressDXTC(GLint format, int w, int h, const unsigned char *src, unsigned char *dest);
+// raise with every change to the blocks compressDXTC writes, cached blocks of another version are encoded again
+enum { DXTC_ENCODER_VERSION = 1 };
+
+// decodes random data with the fast and the reference decoders, compares them and prints megatexels/s;
+// then times the encoder and reports its PSNR; false if any texel differs
+bool benchmarkBLP(int rounds);
+
+#endif
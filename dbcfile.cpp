@@ -55,18 +55,20 @@ bool DBCFile::open()
     if (fieldCount * 4 != recordSize)
         return false;
 
-    data = new unsigned char[recordSize * recordCount + stringSize];
-    stringTable = data + recordSize * recordCount;
-
+    // records are only read, so they are used in place instead of copied out of the file
     size_t data_size = recordSize * recordCount + stringSize;
-    if (f.read(data, data_size) != data_size)
+    if (f.getSize() - f.getPos() < data_size)
         return false;
+
+    MPQView view = f.getView();
+    owner = view.owner;
+    data = (unsigned char*)view.data + f.getPos();
+    stringTable = data + recordSize * recordCount;
     f.close();
     return true;
 }
 DBCFile::~DBCFile()
 {
-    delete [] data;
 }
 
 DBCFile::Record DBCFile::getRecord(size_t id)
@@ -21,6 +21,7 @@
 #define DBCFILE_H
 #include <cassert>
 #include <string>
+#include <memory>
 
 class DBCFile
 {
@@ -134,6 +135,7 @@ class DBCFile
         size_t stringSize;
         unsigned char* data;
         unsigned char* stringTable;
+        std::shared_ptr<const void> owner;                  // keeps the file bytes that data points into alive
 };
 
 #endif
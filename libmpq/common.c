@@ -80,6 +80,14 @@ int32_t libmpq__encrypt_block(uint32_t *in_buf, uint32_t in_size, uint32_t seed)
 }
 
 
+/* decrypt one uint32_t in place, each step depends on the plain text of the one before. */
+#define LIBMPQ_DECRYPT_STEP(value) \
+	seed2  += crypt_buf[0x400 + (seed & 0xFF)]; \
+	ch      = (value) ^ (seed + seed2); \
+	seed    = ((~seed << 0x15) + 0x11111111) | (seed >> 0x0B); \
+	seed2   = ch + seed2 + (seed2 << 5) + 3; \
+	(value) = ch;
+
 /* function to decrypt a block. */
 int32_t libmpq__decrypt_block(uint32_t *in_buf, uint32_t in_size, uint32_t seed) {
 
@@ -87,19 +95,25 @@ int32_t libmpq__decrypt_block(uint32_t *in_buf, uint32_t in_size, uint32_t seed)
 	uint32_t seed2 = 0xEEEEEEEE;
 	uint32_t ch;
 
-	/* we're processing the data 4 bytes at a time. */
-	for (; in_size >= 4; in_size -= 4) {
-		seed2    += crypt_buf[0x400 + (seed & 0xFF)];
-		ch        = *in_buf ^ (seed + seed2);
-		seed      = ((~seed << 0x15) + 0x11111111) | (seed >> 0x0B);
-		seed2     = ch + seed2 + (seed2 << 5) + 3;
-		*in_buf++ = ch;
+	/* sectors are processed 16 bytes per iteration, the chain through seed2 cannot be split, but the loop overhead is gone. */
+	for (; in_size >= 16; in_size -= 16, in_buf += 4) {
+		LIBMPQ_DECRYPT_STEP(in_buf[0]);
+		LIBMPQ_DECRYPT_STEP(in_buf[1]);
+		LIBMPQ_DECRYPT_STEP(in_buf[2]);
+		LIBMPQ_DECRYPT_STEP(in_buf[3]);
+	}
+
+	/* we're processing the rest 4 bytes at a time. */
+	for (; in_size >= 4; in_size -= 4, in_buf++) {
+		LIBMPQ_DECRYPT_STEP(in_buf[0]);
 	}
 
 	/* if no error was found, return decrypted bytes. */
 	return LIBMPQ_SUCCESS;
 }
 
+#undef LIBMPQ_DECRYPT_STEP
+
 /* function to detect decryption key. */
 int32_t libmpq__decrypt_key(uint8_t *in_buf, uint32_t in_size, uint32_t block_size) {
 
@@ -184,7 +198,7 @@ int32_t libmpq__decompress_block(uint8_t *in_buf, uint32_t in_size, uint8_t *out
 			if (compression_type == LIBMPQ_FLAG_COMPRESS_PKZIP) {
 
 				/* decompress using pkzip. */
-				if ((tb = libmpq__decompress_pkzip(in_buf, in_size, out_buf, out_size)) < 0) {
+				if ((tb = libmpq__decompress_single(LIBMPQ_COMPRESSION_PKZIP, in_buf, in_size, out_buf, out_size)) < 0) {
 
 					/* something on decompression failed. */
 					return tb;
@@ -452,8 +452,169 @@ static void data_write_output(char *buf, uint32_t *size, void *param) {
 	info->out_pos += to_write;
 }
 
-/* this function extract the data from input stream. */
-static uint32_t expand(pkzip_cmp_s *mpq_pkzip) {
+/*
+ *  this function decodes symbols from a 64 bit window as long as the input
+ *  buffer holds at least eight more bytes. no symbol is longer than 30 bits,
+ *  so none of the skips done by decode_literal() and decode_distance() could
+ *  run dry here and the checks are left out. the window is handed back in
+ *  the 16 bit form used by skip_bit().
+ *
+ *  returns: 0x305 - end of data.
+ *           0x000 - input buffer nearly empty, continue with decode_literal().
+ */
+static uint32_t expand_fast(pkzip_cmp_s *mpq_pkzip) {
+
+	/* bit window, the lowest bit is the next one in the stream. */
+	uint64_t bit_buf  = mpq_pkzip->bit_buf;
+	uint32_t bit_cnt  = mpq_pkzip->extra_bits + 8;
+
+	/* some common variables, kept local as stores into the output buffer may alias the structure. */
+	uint32_t in_pos   = mpq_pkzip->in_pos;
+	uint32_t in_bytes = mpq_pkzip->in_bytes;
+	uint32_t out_pos  = mpq_pkzip->out_pos;
+	uint32_t ascii    = (mpq_pkzip->cmp_type != LIBMPQ_PKZIP_CMP_BINARY);
+	uint32_t dsize    = mpq_pkzip->dsize_bits;
+	uint32_t dmask    = mpq_pkzip->dsize_mask;
+	uint32_t result   = 0;
+	uint32_t copy_bytes;
+	uint32_t value;
+	uint32_t skip;
+
+	/* loop until end of data or input buffer needs a reload. */
+	while (in_bytes - in_pos >= 8) {
+
+		/* top up the window with whole bytes. */
+		while (bit_cnt <= 56) {
+			bit_buf |= (uint64_t)mpq_pkzip->in_buf[in_pos++] << bit_cnt;
+			bit_cnt += 8;
+		}
+
+		/* check if we have a repetition. */
+		if (bit_buf & 1) {
+
+			/* some common variables. */
+			uint32_t copy_length;
+			uint32_t move_back;
+			uint8_t *target;
+			uint8_t *source;
+
+			/* length code and its extra bits. */
+			value    = mpq_pkzip->pos2[(bit_buf >> 1) & 0xFF];
+			skip     = mpq_pkzip->slen_bits[value] + 1;
+			bit_buf >>= skip;
+			bit_cnt  -= skip;
+			if ((skip = mpq_pkzip->clen_bits[value]) != 0) {
+				value    = mpq_pkzip->len_base[value] + (uint32_t)(bit_buf & ((1 << skip) - 1));
+				bit_buf >>= skip;
+				bit_cnt  -= skip;
+			}
+
+			/* check if end of data. */
+			if (value == 0x205) {
+				result = 0x305;
+				break;
+			}
+			copy_length = value + 2;
+
+			/* distance code and its low bits, two bits only for two byte repetitions. */
+			move_back = mpq_pkzip->pos1[bit_buf & 0xFF];
+			skip      = mpq_pkzip->dist_bits[move_back];
+			bit_buf >>= skip;
+			bit_cnt  -= skip;
+			if (copy_length == 2) {
+				move_back = (move_back << 2) | (uint32_t)(bit_buf & 0x03);
+				skip      = 2;
+			} else {
+				move_back = (move_back << dsize) | (uint32_t)(bit_buf & dmask);
+				skip      = dsize;
+			}
+			bit_buf >>= skip;
+			bit_cnt  -= skip;
+			move_back++;
+
+			/* target and source pointer, overlapping copies repeat a pattern and go byte by byte. */
+			target   = &mpq_pkzip->out_buf[out_pos];
+			source   = target - move_back;
+			out_pos += copy_length;
+			if (move_back >= copy_length) {
+				memcpy(target, source, copy_length);
+			} else {
+				while (copy_length-- > 0) {
+					*target++ = *source++;
+				}
+			}
+		} else {
+
+			/* skip the flag bit. */
+			bit_buf >>= 1;
+			bit_cnt  -= 1;
+
+			/* check the binary compression type, the literal is the next byte. */
+			if (!ascii) {
+				value    = (uint32_t)(bit_buf & 0xFF);
+				bit_buf >>= 8;
+				bit_cnt  -= 8;
+			} else {
+
+				/* ascii literals, same table walk as decode_literal(). */
+				if (bit_buf & 0xFF) {
+					value = mpq_pkzip->offs_2c34[bit_buf & 0xFF];
+					if (value == 0xFF) {
+						if (bit_buf & 0x3F) {
+							bit_buf >>= 4;
+							bit_cnt  -= 4;
+							value     = mpq_pkzip->offs_2d34[bit_buf & 0xFF];
+						} else {
+							bit_buf >>= 6;
+							bit_cnt  -= 6;
+							value     = mpq_pkzip->offs_2e34[bit_buf & 0x7F];
+						}
+					}
+				} else {
+					bit_buf >>= 8;
+					bit_cnt  -= 8;
+					value     = mpq_pkzip->offs_2eb4[bit_buf & 0xFF];
+				}
+				skip      = mpq_pkzip->bits_asc[value];
+				bit_buf >>= skip;
+				bit_cnt  -= skip;
+			}
+
+			/* store the byte. */
+			mpq_pkzip->out_buf[out_pos++] = (uint8_t)value;
+		}
+
+		/* check if number of extracted bytes has reached 1/2 of output buffer, so flush output buffer. */
+		if (out_pos >= 0x2000) {
+
+			/* copy decompressed data into user buffer. */
+			copy_bytes = 0x1000;
+			mpq_pkzip->write_buf((char *)&mpq_pkzip->out_buf[0x1000], &copy_bytes, mpq_pkzip->param);
+
+			/* check if there are some data left, keep them alive. */
+			memmove(mpq_pkzip->out_buf, &mpq_pkzip->out_buf[0x1000], out_pos - 0x1000);
+			out_pos -= 0x1000;
+		}
+	}
+
+	/* give back whole unused bytes, so between 8 and 15 bits stay in the window. */
+	while (bit_cnt >= 16) {
+		bit_cnt -= 8;
+		in_pos--;
+	}
+
+	/* store window and positions. */
+	mpq_pkzip->bit_buf    = (uint32_t)(bit_buf & ((1 << bit_cnt) - 1));
+	mpq_pkzip->extra_bits = bit_cnt - 8;
+	mpq_pkzip->in_pos     = in_pos;
+	mpq_pkzip->out_pos    = out_pos;
+
+	/* return end of data or zero. */
+	return result;
+}
+
+/* this function extract the data from input stream, without the fast path everything is decoded bit by bit. */
+static uint32_t expand(pkzip_cmp_s *mpq_pkzip, uint32_t fast) {
 
 	/* number of bytes to copy. */
 	uint32_t copy_bytes;
@@ -467,8 +628,9 @@ static uint32_t expand(pkzip_cmp_s *mpq_pkzip) {
 	/* initialize output buffer position. */
 	mpq_pkzip->out_pos = 0x1000;
 
-	/* check if end of data or error, so terminate decompress. */
-	while ((result = one_byte = decode_literal(mpq_pkzip)) < 0x305) {
+	/* check if end of data or error, so terminate decompress, the last bytes of each input buffer are decoded bit by bit. */
+	while ((result = fast ? expand_fast(mpq_pkzip) : 0) == 0 &&
+	       (result = one_byte = decode_literal(mpq_pkzip)) < 0x305) {
 
 		/* check if one byte is greater than 0x100, which means 'repeat n - 0xFE bytes'. */
 		if (one_byte >= 0x100) {
@@ -512,7 +674,7 @@ static uint32_t expand(pkzip_cmp_s *mpq_pkzip) {
 			mpq_pkzip->write_buf((char *)&mpq_pkzip->out_buf[0x1000], &copy_bytes, mpq_pkzip->param);
 
 			/* check if there are some data left, keep them alive. */
-			memcpy(mpq_pkzip->out_buf, &mpq_pkzip->out_buf[0x1000], mpq_pkzip->out_pos - 0x1000);
+			memmove(mpq_pkzip->out_buf, &mpq_pkzip->out_buf[0x1000], mpq_pkzip->out_pos - 0x1000);
 			mpq_pkzip->out_pos -= 0x1000;
 		}
 	}
@@ -526,7 +688,7 @@ static uint32_t expand(pkzip_cmp_s *mpq_pkzip) {
 }
 
 /* this function explode the data stream. */
-uint32_t libmpq__do_decompress_pkzip(uint8_t *work_buf, void *param) {
+uint32_t libmpq__do_decompress_pkzip(uint8_t *work_buf, void *param, uint32_t fast) {
 
 	/* some common variables. */
 	pkzip_cmp_s *mpq_pkzip = (pkzip_cmp_s *)work_buf;
@@ -593,7 +755,7 @@ uint32_t libmpq__do_decompress_pkzip(uint8_t *work_buf, void *param) {
 	generate_tables_decode(0x40, mpq_pkzip->dist_bits, pkzip_dist_code, mpq_pkzip->pos1);
 
 	/* check if data extraction works. */
-	if (expand(mpq_pkzip) != 0x306) {
+	if (expand(mpq_pkzip, fast) != 0x306) {
 		return LIBMPQ_PKZIP_CMP_NO_ERROR;
 	}
 
@@ -78,10 +78,11 @@ typedef struct {
 	int32_t		max_out;		/* maximum number of bytes in the output buffer. */
 } pkzip_data_s;
 
-/* decompress the stream using pkzip compression. */
+/* decompress the stream using pkzip compression, fast selects the 64 bit window decoder. */
 uint32_t libmpq__do_decompress_pkzip(
 	uint8_t		*work_buf,
-	void		*param
+	void		*param,
+	uint32_t	fast
 );
 
 #endif						/* _EXPLODE_H */
@@ -29,6 +29,7 @@
 
 /* libmpq main includes. */
 #include "mpq.h"
+#include "mpq-internal.h"
 
 /* libmpq generic includes. */
 #include "explode.h"
@@ -38,16 +39,141 @@
 
 /* table with decompression bits and functions. */
 static decompress_table_s dcmp_table[] = {
-	{LIBMPQ_COMPRESSION_HUFFMAN, libmpq__decompress_huffman},	/* decompression using huffman trees. */
-	{LIBMPQ_COMPRESSION_ZLIB, libmpq__decompress_zlib},	/* decompression with the zlib library. */
-	{LIBMPQ_COMPRESSION_PKZIP, libmpq__decompress_pkzip},	/* decompression with pkware data compression library. */
-	{LIBMPQ_COMPRESSION_BZIP2, libmpq__decompress_bzip2},	/* decompression with bzip2 library. */
-	{LIBMPQ_COMPRESSION_WAVE_MONO, libmpq__decompress_wave_mono},	/* decompression for mono waves. */
-	{LIBMPQ_COMPRESSION_WAVE_STEREO, libmpq__decompress_wave_stereo}	/* decompression for stereo waves. */
+	{LIBMPQ_COMPRESSION_HUFFMAN, libmpq__decompress_huffman, libmpq__decompress_huffman_reference, "huffman"},	/* decompression using huffman trees. */
+	{LIBMPQ_COMPRESSION_ZLIB, libmpq__decompress_zlib, libmpq__decompress_zlib, "zlib"},	/* decompression with the zlib library. */
+	{LIBMPQ_COMPRESSION_PKZIP, libmpq__decompress_pkzip, libmpq__decompress_pkzip_reference, "pkzip"},	/* decompression with pkware data compression library. */
+	{LIBMPQ_COMPRESSION_BZIP2, libmpq__decompress_bzip2, libmpq__decompress_bzip2, "bzip2"},	/* decompression with bzip2 library. */
+	{LIBMPQ_COMPRESSION_WAVE_MONO, libmpq__decompress_wave_mono, libmpq__decompress_wave_mono, "wave mono"},	/* decompression for mono waves. */
+	{LIBMPQ_COMPRESSION_WAVE_STEREO, libmpq__decompress_wave_stereo, libmpq__decompress_wave_stereo, "wave stereo"}	/* decompression for stereo waves. */
 };
 
-/* this function decompress a stream using huffman algorithm. */
-int32_t libmpq__decompress_huffman(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+/* names of the statistics entries which follow the decompression table. */
+static const char *stats_names[] = {
+	"decrypt",						/* sector decryption. */
+	"key search",						/* file seed recovery from the block offset table. */
+	"archive read"						/* sector reads from the archive file. */
+};
+
+/* a codec added to the table without LIBMPQ_STATS_CODECS would share its statistics with the stages. */
+typedef char dcmp_table_size_check[sizeof(dcmp_table) / sizeof(decompress_table_s) == LIBMPQ_STATS_CODECS ? 1 : -1];
+typedef char stats_names_size_check[sizeof(stats_names) / sizeof(char *) == LIBMPQ_STATS_COUNT - LIBMPQ_STATS_CODECS ? 1 : -1];
+
+/* statistics for the entries of the decompression table and the stages after them, only collected while timing is enabled. */
+static decompress_stats_s dcmp_stats[LIBMPQ_STATS_COUNT];
+static uint32_t dcmp_timing;
+static uint32_t dcmp_reference;
+static uint32_t dcmp_lock_init;
+static libmpq__mutex_t dcmp_lock;
+
+/* this function enables or disables the codec statistics and resets them, it must not run while other threads decompress. */
+int32_t libmpq__codec_timing(uint32_t enable) {
+
+	/* create the lock on first use. */
+	if (dcmp_lock_init == 0) {
+		libmpq__mutex_init(&dcmp_lock);
+		dcmp_lock_init = 1;
+	}
+
+	/* reset statistics. */
+	memset(dcmp_stats, 0, sizeof(dcmp_stats));
+	dcmp_timing = enable;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function selects the reference or the fast decoders, it must not run while other threads decompress. */
+int32_t libmpq__codec_reference(uint32_t enable) {
+
+	/* select decoders. */
+	dcmp_reference = enable;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function returns the statistics of one codec or stage. */
+int32_t libmpq__codec_stats(uint32_t codec_number, const char **name, uint64_t *calls, uint64_t *in_bytes, uint64_t *out_bytes, uint64_t *nanoseconds) {
+
+	/* check if given codec number is not out of range. */
+	if (codec_number >= sizeof(dcmp_stats) / sizeof(decompress_stats_s)) {
+
+		/* codec number is out of range. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* return name and statistics. */
+	*name        = codec_number < LIBMPQ_STATS_CODECS ? dcmp_table[codec_number].name : stats_names[codec_number - LIBMPQ_STATS_CODECS];
+	*calls       = dcmp_stats[codec_number].calls;
+	*in_bytes    = dcmp_stats[codec_number].in_bytes;
+	*out_bytes   = dcmp_stats[codec_number].out_bytes;
+	*nanoseconds = dcmp_stats[codec_number].nanoseconds;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function returns the start time for libmpq__stats_add() or zero if timing is disabled. */
+uint64_t libmpq__stats_start(void) {
+	return dcmp_timing ? libmpq__clock() : 0;
+}
+
+/* this function adds one successful call to the given statistics entry. */
+void libmpq__stats_add(uint32_t entry, uint32_t in_bytes, uint32_t out_bytes, uint64_t start) {
+
+	/* some common variables. */
+	uint64_t elapsed;
+
+	/* check if timing was enabled at start. */
+	if (start == 0) {
+		return;
+	}
+
+	/* add call. */
+	elapsed = libmpq__clock() - start;
+	libmpq__mutex_lock(&dcmp_lock);
+	dcmp_stats[entry].calls++;
+	dcmp_stats[entry].in_bytes    += in_bytes;
+	dcmp_stats[entry].out_bytes   += out_bytes;
+	dcmp_stats[entry].nanoseconds += elapsed;
+	libmpq__mutex_unlock(&dcmp_lock);
+}
+
+/* this function calls one entry of the decompression table and counts it while timing is enabled. */
+static int32_t libmpq__decompress_entry(uint32_t entry, uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+
+	/* some common variables. */
+	uint64_t start = libmpq__stats_start();
+	int32_t tb     = (dcmp_reference ? dcmp_table[entry].reference : dcmp_table[entry].decompress)(in_buf, in_size, out_buf, out_size);
+
+	/* only successful calls are counted. */
+	if (tb >= 0) {
+		libmpq__stats_add(entry, in_size, tb, start);
+	}
+
+	/* return transferred bytes or error. */
+	return tb;
+}
+
+/* this function decompress a stream using one algorithm given by its compression bit. */
+int32_t libmpq__decompress_single(uint32_t mask, uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+
+	/* some common variables. */
+	uint32_t i;
+
+	/* search decompression table. */
+	for (i = 0; i < sizeof(dcmp_table) / sizeof(decompress_table_s); i++) {
+		if (dcmp_table[i].mask == mask) {
+			return libmpq__decompress_entry(i, in_buf, in_size, out_buf, out_size);
+		}
+	}
+
+	/* compression type is unknown. */
+	return LIBMPQ_ERROR_UNPACK;
+}
+
+/* this function decompress a stream using huffman algorithm, with the fast or the reference tree walk. */
+static int32_t decompress_huffman(uint8_t *in_buf, uint8_t *out_buf, uint32_t out_size, uint32_t fast) {
 
 	/* TODO: make typdefs of this structs? */
 	/* some common variables. */
@@ -84,7 +210,7 @@ int32_t libmpq__decompress_huffman(uint8_t *in_buf, uint32_t in_size, uint8_t *o
 	libmpq__huffman_tree_init(ht, LIBMPQ_HUFF_DECOMPRESS);
 
 	/* save the number of copied bytes. */
-	tb = libmpq__do_decompress_huffman(ht, is, out_buf, out_size);
+	tb = libmpq__do_decompress_huffman(ht, is, out_buf, out_size, fast);
 
 	/* free structures. */
 	free(is);
@@ -94,6 +220,16 @@ int32_t libmpq__decompress_huffman(uint8_t *in_buf, uint32_t in_size, uint8_t *o
 	return tb;
 }
 
+/* this function decompress a stream using huffman algorithm. */
+int32_t libmpq__decompress_huffman(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+	return decompress_huffman(in_buf, out_buf, out_size, TRUE);
+}
+
+/* this function decompress a stream using huffman algorithm and the reference tree walk. */
+int32_t libmpq__decompress_huffman_reference(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+	return decompress_huffman(in_buf, out_buf, out_size, FALSE);
+}
+
 /* this function decompress a stream using zlib algorithm. */
 int32_t libmpq__decompress_zlib(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
 
@@ -140,8 +276,8 @@ int32_t libmpq__decompress_zlib(uint8_t *in_buf, uint32_t in_size, uint8_t *out_
 	return tb;
 }
 
-/* this function decompress a stream using pkzip algorithm. */
-int32_t libmpq__decompress_pkzip(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+/* this function decompress a stream using pkzip algorithm, with or without the fast path. */
+static int32_t decompress_pkzip(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size, uint32_t fast) {
 
 	/* some common variables. */
 	int32_t tb = 0;
@@ -155,10 +291,7 @@ int32_t libmpq__decompress_pkzip(uint8_t *in_buf, uint32_t in_size, uint8_t *out
 		return LIBMPQ_ERROR_MALLOC;
 	}
 
-	/* cleanup. */
-	memset(work_buf, 0, sizeof(pkzip_cmp_s));
-
-	/* fill data information structure. */
+	/* fill data information structure, the work buffer is cleared by the decompression. */
 	info.in_buf   = in_buf;
 	info.in_pos   = 0;
 	info.in_bytes = in_size;
@@ -167,7 +300,7 @@ int32_t libmpq__decompress_pkzip(uint8_t *in_buf, uint32_t in_size, uint8_t *out
 	info.max_out  = out_size;
 
 	/* do the decompression. */
-	if ((tb = libmpq__do_decompress_pkzip(work_buf, &info)) < 0) {
+	if ((tb = libmpq__do_decompress_pkzip(work_buf, &info, fast)) < 0) {
 
 		/* free working buffer. */
 		free(work_buf);
@@ -186,6 +319,16 @@ int32_t libmpq__decompress_pkzip(uint8_t *in_buf, uint32_t in_size, uint8_t *out
 	return tb;
 }
 
+/* this function decompress a stream using pkzip algorithm. */
+int32_t libmpq__decompress_pkzip(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+	return decompress_pkzip(in_buf, in_size, out_buf, out_size, TRUE);
+}
+
+/* this function decompress a stream using pkzip algorithm bit by bit. */
+int32_t libmpq__decompress_pkzip_reference(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
+	return decompress_pkzip(in_buf, in_size, out_buf, out_size, FALSE);
+}
+
 /* this function decompress a stream using bzip2 library. */
 int32_t libmpq__decompress_bzip2(uint8_t *in_buf, uint32_t in_size, uint8_t *out_buf, uint32_t out_size) {
 
@@ -328,7 +471,7 @@ int32_t libmpq__decompress_multi(uint8_t *in_buf, uint32_t in_size, uint8_t *out
 			}
 
 			/* decompress buffer using corresponding function. */
-			if ((tb = dcmp_table[i].decompress(in_buf, in_size, work_buf, out_size)) < 0) {
+			if ((tb = libmpq__decompress_entry(i, in_buf, in_size, work_buf, out_size)) < 0) {
 
 				/* free temporary buffer. */
 				free(temp_buf);
@@ -40,8 +40,49 @@ typedef int32_t		(*DECOMPRESS)(uint8_t *, uint32_t, uint8_t *, uint32_t);
 typedef struct {
 	uint32_t	mask;			/* decompression bit. */
 	DECOMPRESS	decompress;		/* decompression function. */
+	DECOMPRESS	reference;		/* decompression function used while the reference decoders are selected. */
+	const char	*name;			/* codec name for the statistics. */
 } decompress_table_s;
 
+/* statistics entries, one per entry of the decompression table followed by the other stages. */
+enum {
+	LIBMPQ_STATS_CODECS = 6,				/* entries in the decompression table, checked in extract.c. */
+	LIBMPQ_STATS_DECRYPT = LIBMPQ_STATS_CODECS,		/* sector decryption. */
+	LIBMPQ_STATS_KEY,					/* file seed recovery. */
+	LIBMPQ_STATS_READ,					/* sector reads from the archive file (not the mapping). */
+	LIBMPQ_STATS_COUNT
+};
+
+/* statistics for one entry of the decompression table. */
+typedef struct {
+	uint64_t	calls;			/* number of successful decompressions. */
+	uint64_t	in_bytes;		/* compressed bytes. */
+	uint64_t	out_bytes;		/* decompressed bytes. */
+	uint64_t	nanoseconds;		/* time spent in the decompression function. */
+} decompress_stats_s;
+
+/* start time for the statistics, zero while timing is disabled. */
+extern uint64_t libmpq__stats_start(
+	void
+);
+
+/* add one successful call to the statistics. */
+extern void libmpq__stats_add(
+	uint32_t	entry,
+	uint32_t	in_bytes,
+	uint32_t	out_bytes,
+	uint64_t	start
+);
+
+/* decompression using one algorithm of the table given by its compression bit. */
+extern int32_t libmpq__decompress_single(
+	uint32_t	mask,
+	uint8_t		*in_buf,
+	uint32_t	in_size,
+	uint8_t		*out_buf,
+	uint32_t	out_size
+);
+
 /*
  *  huffman decompression routine, the in_size parameter is not used,
  *  but needs to be specified due to compatibility reasons.
@@ -55,6 +96,14 @@ extern int32_t libmpq__decompress_huffman(
 	uint32_t	out_size
 );
 
+/* huffman decompression walking the tree with libmpq__huffman_get_1bit(), to compare against. */
+extern int32_t libmpq__decompress_huffman_reference(
+	uint8_t		*in_buf,
+	uint32_t	in_size,
+	uint8_t		*out_buf,
+	uint32_t	out_size
+);
+
 /* decompression using zlib. */
 extern int32_t libmpq__decompress_zlib(
 	uint8_t		*in_buf,
@@ -71,6 +120,14 @@ extern int32_t libmpq__decompress_pkzip(
 	uint32_t	out_size
 );
 
+/* decompression using pkzip, bit by bit without the 64 bit window, to compare against. */
+extern int32_t libmpq__decompress_pkzip_reference(
+	uint8_t		*in_buf,
+	uint32_t	in_size,
+	uint8_t		*out_buf,
+	uint32_t	out_size
+);
+
 /* decompression using bzip2. */
 extern int32_t libmpq__decompress_bzip2(
 	uint8_t		*in_buf,
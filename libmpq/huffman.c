@@ -931,8 +931,20 @@ void libmpq__huffman_tree_build(struct huffman_tree_s *ht, uint32_t cmp_type) {
 	ht->offs0004 = 1;
 }
 
-/* this function did the real decompression. */
-int32_t libmpq__do_decompress_huffman(struct huffman_tree_s *ht, struct huffman_input_stream_s *is, uint8_t *out_buf, uint32_t out_length) {
+/*
+ *  this function did the real decompression.
+ *
+ *  there is deliberately no wider lookup table than the 7 bit quick table
+ *  qd3474. its entries are only valid while no item was swapped (offs0004),
+ *  but a 0x101 insert without a swap leaves them in place although the tree
+ *  changed below them, and storm decodes with those stale entries. a wider
+ *  table would have to be invalidated on every change of the tree, which
+ *  are exactly the swaps and inserts that already empty the quick table, so
+ *  it would be refilled by the same tree walks and could not save any. with
+ *  compression type 0 the tree is updated after every byte. so only the
+ *  tree walk itself is faster, the reference walk is kept to compare with.
+ */
+int32_t libmpq__do_decompress_huffman(struct huffman_tree_s *ht, struct huffman_input_stream_s *is, uint8_t *out_buf, uint32_t out_length, uint32_t fast) {
 
 	/* some common variables. */
 	uint32_t dcmp_byte = 0;
@@ -954,6 +966,11 @@ int32_t libmpq__do_decompress_huffman(struct huffman_tree_s *ht, struct huffman_
 	/* can we use quick decompression */
 	uint32_t has_qd;
 
+	/* input stream while walking down the tree. */
+	uint32_t bit_buf;
+	uint32_t bits;
+	uint8_t *in_buf;
+
 	/* test the output length, must not be non zero. */
 	if (out_length == 0) {
 		return 0;
@@ -1007,22 +1024,60 @@ int32_t libmpq__do_decompress_huffman(struct huffman_tree_s *ht, struct huffman_
 			bit_count = 0;
 			p_item2   = NULL;
 
-			/* loop until tree has no deeper level. */
-			do {
+			/* the reference walk reads every bit through libmpq__huffman_get_1bit() like storm does. */
+			if (fast == FALSE) {
 
-				/* move down by one level. */
-				p_item1 = p_item1->child;
+				/* loop until tree has no deeper level. */
+				do {
 
-				/* check if current bit is set, move to previous. */
-				if (libmpq__huffman_get_1bit(is)) {
-					p_item1 = p_item1->prev;
-				}
+					/* move down by one level. */
+					p_item1 = p_item1->child;
 
-				/* check if we are at 7th bit, save current huffman tree item. */
-				if (++bit_count == 7) {
-					p_item2 = p_item1;
-				}
-			} while (p_item1->child != NULL);
+					/* check if current bit is set, move to previous. */
+					if (libmpq__huffman_get_1bit(is)) {
+						p_item1 = p_item1->prev;
+					}
+
+					/* check if we are at 7th bit, save current huffman tree item. */
+					if (++bit_count == 7) {
+						p_item2 = p_item1;
+					}
+				} while (p_item1->child != NULL);
+			} else {
+
+				/* work on a local copy of the input stream, reloaded like libmpq__huffman_get_1bit() does. */
+				bit_buf = is->bit_buf;
+				bits    = is->bits;
+				in_buf  = is->in_buf;
+
+				/* loop until tree has no deeper level. */
+				do {
+
+					/* move down by one level, the set bit moves to previous. */
+					p_item1 = p_item1->child;
+					if (bit_buf & 1) {
+						p_item1 = p_item1->prev;
+					}
+
+					/* shift bit out and check if we should extract bits. */
+					bit_buf >>= 1;
+					if (--bits == 0) {
+						bit_buf  = *(uint32_t *)in_buf;
+						in_buf  += sizeof(int32_t);
+						bits     = 32;
+					}
+
+					/* check if we are at 7th bit, save current huffman tree item. */
+					if (++bit_count == 7) {
+						p_item2 = p_item1;
+					}
+				} while (p_item1->child != NULL);
+
+				/* store input stream. */
+				is->bit_buf = bit_buf;
+				is->bits    = bits;
+				is->in_buf  = in_buf;
+			}
 
 			/* no quick decompression. :( */
 			if (has_qd == FALSE) {
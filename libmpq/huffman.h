@@ -140,12 +140,13 @@ void libmpq__huffman_tree_build(
 	uint32_t	cmp_type
 );
 
-/* decompress the stream using huffman compression. */
+/* decompress the stream using huffman compression, fast walks the tree without libmpq__huffman_get_1bit(). */
 int32_t libmpq__do_decompress_huffman(
 	struct		huffman_tree_s *ht,
 	struct		huffman_input_stream_s *is,
 	uint8_t		*out_buf,
-	uint32_t	out_length
+	uint32_t	out_length,
+	uint32_t	fast
 );
 
 #endif						/* _HUFFMAN_H */
@@ -0,0 +1,203 @@
+/*
+ *  md5.c -- md5 message digest used to verify files against the
+ *           (attributes) file.
+ *
+ *  The algorithm follows RFC 1321 (the md5 message-digest algorithm).
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* generic includes. */
+#include <string.h>
+
+/* libmpq generic includes. */
+#include "mpq-internal.h"
+
+/* libmpq main includes. */
+#include "md5.h"
+
+/* the four auxiliary functions and one step of a round. */
+#define MD5_F(x, y, z)			(((x) & (y)) | (~(x) & (z)))
+#define MD5_G(x, y, z)			(((x) & (z)) | ((y) & ~(z)))
+#define MD5_H(x, y, z)			((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z)			((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, t, s) \
+	(a) += f((b), (c), (d)) + (x) + (t); \
+	(a) = ((a) << (s)) | ((a) >> (32 - (s))); \
+	(a) += (b);
+
+/* this function hashes one 64 byte block. */
+static void libmpq__md5_transform(uint32_t *state, const uint8_t *block) {
+
+	/* some common variables. */
+	uint32_t a = state[0];
+	uint32_t b = state[1];
+	uint32_t c = state[2];
+	uint32_t d = state[3];
+	uint32_t x[16];
+	uint32_t i;
+
+	/* input words are little endian. */
+	for (i = 0; i < 16; i++) {
+		x[i] = (uint32_t)block[i * 4] | ((uint32_t)block[i * 4 + 1] << 8) | ((uint32_t)block[i * 4 + 2] << 16) | ((uint32_t)block[i * 4 + 3] << 24);
+	}
+
+	/* round one. */
+	MD5_STEP(MD5_F, a, b, c, d, x[ 0], 0xD76AA478,  7)
+	MD5_STEP(MD5_F, d, a, b, c, x[ 1], 0xE8C7B756, 12)
+	MD5_STEP(MD5_F, c, d, a, b, x[ 2], 0x242070DB, 17)
+	MD5_STEP(MD5_F, b, c, d, a, x[ 3], 0xC1BDCEEE, 22)
+	MD5_STEP(MD5_F, a, b, c, d, x[ 4], 0xF57C0FAF,  7)
+	MD5_STEP(MD5_F, d, a, b, c, x[ 5], 0x4787C62A, 12)
+	MD5_STEP(MD5_F, c, d, a, b, x[ 6], 0xA8304613, 17)
+	MD5_STEP(MD5_F, b, c, d, a, x[ 7], 0xFD469501, 22)
+	MD5_STEP(MD5_F, a, b, c, d, x[ 8], 0x698098D8,  7)
+	MD5_STEP(MD5_F, d, a, b, c, x[ 9], 0x8B44F7AF, 12)
+	MD5_STEP(MD5_F, c, d, a, b, x[10], 0xFFFF5BB1, 17)
+	MD5_STEP(MD5_F, b, c, d, a, x[11], 0x895CD7BE, 22)
+	MD5_STEP(MD5_F, a, b, c, d, x[12], 0x6B901122,  7)
+	MD5_STEP(MD5_F, d, a, b, c, x[13], 0xFD987193, 12)
+	MD5_STEP(MD5_F, c, d, a, b, x[14], 0xA679438E, 17)
+	MD5_STEP(MD5_F, b, c, d, a, x[15], 0x49B40821, 22)
+
+	/* round two. */
+	MD5_STEP(MD5_G, a, b, c, d, x[ 1], 0xF61E2562,  5)
+	MD5_STEP(MD5_G, d, a, b, c, x[ 6], 0xC040B340,  9)
+	MD5_STEP(MD5_G, c, d, a, b, x[11], 0x265E5A51, 14)
+	MD5_STEP(MD5_G, b, c, d, a, x[ 0], 0xE9B6C7AA, 20)
+	MD5_STEP(MD5_G, a, b, c, d, x[ 5], 0xD62F105D,  5)
+	MD5_STEP(MD5_G, d, a, b, c, x[10], 0x02441453,  9)
+	MD5_STEP(MD5_G, c, d, a, b, x[15], 0xD8A1E681, 14)
+	MD5_STEP(MD5_G, b, c, d, a, x[ 4], 0xE7D3FBC8, 20)
+	MD5_STEP(MD5_G, a, b, c, d, x[ 9], 0x21E1CDE6,  5)
+	MD5_STEP(MD5_G, d, a, b, c, x[14], 0xC33707D6,  9)
+	MD5_STEP(MD5_G, c, d, a, b, x[ 3], 0xF4D50D87, 14)
+	MD5_STEP(MD5_G, b, c, d, a, x[ 8], 0x455A14ED, 20)
+	MD5_STEP(MD5_G, a, b, c, d, x[13], 0xA9E3E905,  5)
+	MD5_STEP(MD5_G, d, a, b, c, x[ 2], 0xFCEFA3F8,  9)
+	MD5_STEP(MD5_G, c, d, a, b, x[ 7], 0x676F02D9, 14)
+	MD5_STEP(MD5_G, b, c, d, a, x[12], 0x8D2A4C8A, 20)
+
+	/* round three. */
+	MD5_STEP(MD5_H, a, b, c, d, x[ 5], 0xFFFA3942,  4)
+	MD5_STEP(MD5_H, d, a, b, c, x[ 8], 0x8771F681, 11)
+	MD5_STEP(MD5_H, c, d, a, b, x[11], 0x6D9D6122, 16)
+	MD5_STEP(MD5_H, b, c, d, a, x[14], 0xFDE5380C, 23)
+	MD5_STEP(MD5_H, a, b, c, d, x[ 1], 0xA4BEEA44,  4)
+	MD5_STEP(MD5_H, d, a, b, c, x[ 4], 0x4BDECFA9, 11)
+	MD5_STEP(MD5_H, c, d, a, b, x[ 7], 0xF6BB4B60, 16)
+	MD5_STEP(MD5_H, b, c, d, a, x[10], 0xBEBFBC70, 23)
+	MD5_STEP(MD5_H, a, b, c, d, x[13], 0x289B7EC6,  4)
+	MD5_STEP(MD5_H, d, a, b, c, x[ 0], 0xEAA127FA, 11)
+	MD5_STEP(MD5_H, c, d, a, b, x[ 3], 0xD4EF3085, 16)
+	MD5_STEP(MD5_H, b, c, d, a, x[ 6], 0x04881D05, 23)
+	MD5_STEP(MD5_H, a, b, c, d, x[ 9], 0xD9D4D039,  4)
+	MD5_STEP(MD5_H, d, a, b, c, x[12], 0xE6DB99E5, 11)
+	MD5_STEP(MD5_H, c, d, a, b, x[15], 0x1FA27CF8, 16)
+	MD5_STEP(MD5_H, b, c, d, a, x[ 2], 0xC4AC5665, 23)
+
+	/* round four. */
+	MD5_STEP(MD5_I, a, b, c, d, x[ 0], 0xF4292244,  6)
+	MD5_STEP(MD5_I, d, a, b, c, x[ 7], 0x432AFF97, 10)
+	MD5_STEP(MD5_I, c, d, a, b, x[14], 0xAB9423A7, 15)
+	MD5_STEP(MD5_I, b, c, d, a, x[ 5], 0xFC93A039, 21)
+	MD5_STEP(MD5_I, a, b, c, d, x[12], 0x655B59C3,  6)
+	MD5_STEP(MD5_I, d, a, b, c, x[ 3], 0x8F0CCC92, 10)
+	MD5_STEP(MD5_I, c, d, a, b, x[10], 0xFFEFF47D, 15)
+	MD5_STEP(MD5_I, b, c, d, a, x[ 1], 0x85845DD1, 21)
+	MD5_STEP(MD5_I, a, b, c, d, x[ 8], 0x6FA87E4F,  6)
+	MD5_STEP(MD5_I, d, a, b, c, x[15], 0xFE2CE6E0, 10)
+	MD5_STEP(MD5_I, c, d, a, b, x[ 6], 0xA3014314, 15)
+	MD5_STEP(MD5_I, b, c, d, a, x[13], 0x4E0811A1, 21)
+	MD5_STEP(MD5_I, a, b, c, d, x[ 4], 0xF7537E82,  6)
+	MD5_STEP(MD5_I, d, a, b, c, x[11], 0xBD3AF235, 10)
+	MD5_STEP(MD5_I, c, d, a, b, x[ 2], 0x2AD7D2BB, 15)
+	MD5_STEP(MD5_I, b, c, d, a, x[ 9], 0xEB86D391, 21)
+
+	/* add this block to the digest. */
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+/* this function starts a new digest. */
+void libmpq__md5_init(md5_ctx_s *ctx) {
+
+	/* initial state from the rfc. */
+	ctx->state[0] = 0x67452301;
+	ctx->state[1] = 0xEFCDAB89;
+	ctx->state[2] = 0x98BADCFE;
+	ctx->state[3] = 0x10325476;
+	ctx->length   = 0;
+}
+
+/* this function hashes more input. */
+void libmpq__md5_update(md5_ctx_s *ctx, const uint8_t *in_buf, uint32_t in_size) {
+
+	/* some common variables. */
+	uint32_t used = (uint32_t)(ctx->length & 63);
+	uint32_t fill;
+
+	/* count input. */
+	ctx->length += in_size;
+
+	/* complete a partial block first. */
+	if (used > 0) {
+		fill = 64 - used;
+		if (in_size < fill) {
+			memcpy(ctx->buffer + used, in_buf, in_size);
+			return;
+		}
+		memcpy(ctx->buffer + used, in_buf, fill);
+		libmpq__md5_transform(ctx->state, ctx->buffer);
+		in_buf  += fill;
+		in_size -= fill;
+	}
+
+	/* whole blocks are hashed straight from the input. */
+	while (in_size >= 64) {
+		libmpq__md5_transform(ctx->state, in_buf);
+		in_buf  += 64;
+		in_size -= 64;
+	}
+
+	/* keep the rest for the next call. */
+	memcpy(ctx->buffer, in_buf, in_size);
+}
+
+/* this function finishes the digest. */
+void libmpq__md5_final(md5_ctx_s *ctx, uint8_t *digest) {
+
+	/* some common variables. */
+	uint64_t bits = ctx->length << 3;
+	uint8_t padding[72];
+	uint32_t pad_size;
+	uint32_t i;
+
+	/* pad with one bit and zeros up to 56 bytes modulo 64, then the length in bits. */
+	pad_size = (uint32_t)((ctx->length & 63) < 56 ? 56 - (ctx->length & 63) : 120 - (ctx->length & 63));
+	memset(padding, 0, sizeof(padding));
+	padding[0] = 0x80;
+	for (i = 0; i < 8; i++) {
+		padding[pad_size + i] = (uint8_t)(bits >> (i * 8));
+	}
+	libmpq__md5_update(ctx, padding, pad_size + 8);
+
+	/* digest is little endian. */
+	for (i = 0; i < 16; i++) {
+		digest[i] = (uint8_t)(ctx->state[i / 4] >> ((i % 4) * 8));
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ *  md5.h -- header file for the md5 message digest used to verify files
+ *           against the (attributes) file.
+ *
+ *  The algorithm follows RFC 1321 (the md5 message-digest algorithm).
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MD5_H
+#define _MD5_H
+
+/* md5 state between updates. */
+typedef struct {
+	uint32_t	state[4];		/* digest so far. */
+	uint64_t	length;			/* bytes hashed so far. */
+	uint8_t		buffer[64];		/* partial input block. */
+} md5_ctx_s;
+
+/* function to start a new digest. */
+void libmpq__md5_init(
+	md5_ctx_s	*ctx
+);
+
+/* function to hash more input. */
+void libmpq__md5_update(
+	md5_ctx_s	*ctx,
+	const uint8_t	*in_buf,
+	uint32_t	in_size
+);
+
+/* function to finish the digest. */
+void libmpq__md5_final(
+	md5_ctx_s	*ctx,
+	uint8_t		*digest
+);
+
+#endif						/* _MD5_H */
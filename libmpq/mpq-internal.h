@@ -26,6 +26,9 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/* support for platform specific things */
+#include "platform.h"
+
 /* define return value if nothing failed. */
 #define LIBMPQ_SUCCESS				0		/* return value for all functions which success. */
 
@@ -49,11 +52,20 @@
 /* define generic hash values. */
 #define LIBMPQ_HASH_FREE			0xFFFFFFFF	/* hash table entry is empty and has always been empty. */
 
+/* define sidecar table cache values. */
+#define LIBMPQ_CACHE_MAGIC			0x43544D4C	/* sidecar signature 'LMTC'. */
+#define LIBMPQ_CACHE_VERSION			1		/* bumped whenever the sidecar layout changes. */
+#define LIBMPQ_CACHE_PATH			1024		/* longest path of a sidecar file. */
+
 /* define special files. */
 #define LIBMPQ_LISTFILE_NAME			"(listfile)"	/* internal listfile. */
 #define LIBMPQ_SIGNATURE_NAME			"(signature)"	/* internal signature file. */
 #define LIBMPQ_ATTRIBUTES_NAME			"(attributes)"	/* internal attributes file. */
 
+/* define (attributes) layout, the header is followed by one array per flag, each with an entry per block. */
+#define LIBMPQ_ATTRIBUTES_HEADER		8		/* version and flags. */
+#define LIBMPQ_ATTRIBUTES_FILETIME		0x00000002	/* array of 64 bit file times. */
+
 /* define true and false, because not all systems have them. */
 #ifndef FALSE
 #define FALSE 0
@@ -117,6 +129,18 @@ typedef struct {
 	uint32_t	block_table_indices;	/* real mapping for file number to block entry. */
 	uint32_t	block_table_diff;	/* block table difference between valid blocks and invalid blocks before. */
 } PACK_STRUCT mpq_map_s;
+
+/* header of the sidecar file which stores the decrypted tables of an archive. */
+typedef struct {
+	uint32_t	magic;			/* sidecar signature. */
+	uint32_t	version;		/* sidecar layout version. */
+	uint64_t	file_size;		/* size of the archive file the tables belong to. */
+	int64_t		file_mtime;		/* modification time of the archive file. */
+	int64_t		archive_offset;		/* absolute start position of archive. */
+	uint32_t	files;			/* number of valid files. */
+	mpq_header_s	mpq_header;		/* mpq file header. */
+	mpq_header_ex_s	mpq_header_ex;		/* mpq extended file header. */
+} PACK_STRUCT mpq_cache_s;
 #include "pack_end.h"
 
 /* archive structure used since diablo 1.00 by blizzard. */
@@ -125,6 +149,14 @@ struct mpq_archive {
 	/* generic file information. */
 	FILE		*fp;			/* file handle. */
 
+	/* memory mapping information, only used if opened with LIBMPQ_OPEN_MMAP. */
+	uint8_t		*map;			/* start of the mapped archive file or NULL if not mapped. */
+	uint64_t	map_size;		/* size of the mapped archive file. */
+	void		*map_handle;		/* file mapping object (only used on windows). */
+
+	/* synchronization between threads reading from the same archive. */
+	libmpq__mutex_t	file_lock;		/* protects mpq_file and the open counters. */
+
 	/* generic size information. */
 	uint32_t	block_size;		/* size of the mpq block. */
 	off_t		archive_offset;		/* absolute start position of archive. */
@@ -136,6 +168,10 @@ struct mpq_archive {
 	mpq_block_s	*mpq_block;		/* block table. */
 	mpq_block_ex_s	*mpq_block_ex;		/* extended block table. */
 	mpq_file_s	**mpq_file;		/* pointer to the file pointers which are opened. */
+	uint32_t	*mpq_seed;		/* derived file seeds by file number, kept after the file is closed (zero if not derived yet). */
+	uint8_t		*mpq_attributes;	/* (attributes) file, loaded by the first libmpq__file_verify() call. */
+	uint32_t	attributes_size;	/* size of the (attributes) file. */
+	uint32_t	attributes_state;	/* 0 if not loaded yet, 1 if loaded, 2 if missing or damaged. */
 
 	/* non archive structure related members. */
 	mpq_map_s	*mpq_map;		/* map table between valid blocks and hashes. */
@@ -27,6 +27,11 @@
 
 /* libmpq generic includes. */
 #include "common.h"
+#include "extract.h"
+#include "md5.h"
+
+/* zlib includes. */
+#include <zlib.h>
 
 /* generic includes. */
 #include <fcntl.h>
@@ -37,6 +42,18 @@
 /* support for platform specific things */
 #include "platform.h"
 
+/* memory mapping includes. */
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* largest block which is decrypted on the stack when reading from a mapped archive. */
+#define LIBMPQ_STACK_BLOCK_SIZE			0x4000
+
 /* this function returns the library version information. */
 const char *libmpq__version(void) {
 
@@ -44,13 +61,394 @@ const char *libmpq__version(void) {
 	return VERSION;
 }
 
+/* this function reads from the given absolute file position without moving a shared file pointer, so several threads can read at once. */
+static int64_t libmpq__archive_pread(mpq_archive_s *mpq_archive, void *buf, uint32_t size, libmpq__off_t offset) {
+
+#ifdef _WIN32
+	/* some common variables. */
+	OVERLAPPED ov;
+	DWORD rb = 0;
+
+	/* the offset in the overlapped structure is used instead of the file pointer. */
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset     = (DWORD)(offset & 0xFFFFFFFF);
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+
+	/* read from file. */
+	if (!ReadFile((HANDLE)_get_osfhandle(_fileno(mpq_archive->fp)), buf, size, &rb, &ov) && GetLastError() != ERROR_HANDLE_EOF) {
+
+		/* something on read failed. */
+		return -1;
+	}
+
+	/* return read bytes. */
+	return rb;
+#else
+	/* read from file. */
+	return pread(fileno(mpq_archive->fp), buf, size, offset);
+#endif
+}
+
+/* this function maps the whole archive file into memory, on failure the archive is simply left unmapped. */
+static void libmpq__archive_map(mpq_archive_s *mpq_archive) {
+
+#ifdef _WIN32
+	/* some common variables. */
+	HANDLE file;
+	HANDLE mapping;
+	LARGE_INTEGER size;
+
+	/* get the native handle and the size of the opened file. */
+	file = (HANDLE)_get_osfhandle(_fileno(mpq_archive->fp));
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+
+		/* nothing to map. */
+		return;
+	}
+
+	/* create the mapping object. */
+	if ((mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL) {
+
+		/* mapping failed, we will use the stdio path. */
+		return;
+	}
+
+	/* map the whole file, this fails on 32 bit builds if the archive does not fit into the address space. */
+	if ((mpq_archive->map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) == NULL) {
+
+		/* mapping failed, we will use the stdio path. */
+		CloseHandle(mapping);
+		return;
+	}
+
+	/* store mapping information. */
+	mpq_archive->map_handle = mapping;
+	mpq_archive->map_size   = size.QuadPart;
+#else
+	/* some common variables. */
+	struct stat st;
+	void *map;
+
+	/* get the size of the opened file. */
+	if (fstat(fileno(mpq_archive->fp), &st) < 0 || st.st_size == 0) {
+
+		/* nothing to map. */
+		return;
+	}
+
+	/* map the whole file read only. */
+	if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(mpq_archive->fp), 0)) == MAP_FAILED) {
+
+		/* mapping failed, we will use the stdio path. */
+		return;
+	}
+
+	/* store mapping information. */
+	mpq_archive->map      = map;
+	mpq_archive->map_size = st.st_size;
+#endif
+}
+
+/* this function releases the mapping created by libmpq__archive_map(). */
+static void libmpq__archive_unmap(mpq_archive_s *mpq_archive) {
+
+	/* check if archive is mapped at all. */
+	if (mpq_archive->map == NULL) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(mpq_archive->map);
+	CloseHandle(mpq_archive->map_handle);
+#else
+	munmap(mpq_archive->map, mpq_archive->map_size);
+#endif
+
+	/* mark archive as unmapped. */
+	mpq_archive->map        = NULL;
+	mpq_archive->map_size   = 0;
+	mpq_archive->map_handle = NULL;
+}
+
 /* this function read a file and verify if it is a valid mpq archive, then it read and decrypt the hash table. */
 int32_t libmpq__archive_open(mpq_archive_s **mpq_archive, const char *mpq_filename, libmpq__off_t archive_offset) {
 
+	/* open archive with the default stdio reader. */
+	return libmpq__archive_open_flags(mpq_archive, mpq_filename, archive_offset, 0);
+}
+
+/* directory for the sidecar table cache, empty if disabled. */
+static char libmpq__cache_directory[LIBMPQ_CACHE_PATH] = "";
+
+/* this function sets the directory for sidecar table files, it must be called before archives are opened. */
+int32_t libmpq__cache_dir(const char *cache_dir) {
+
+	/* check if path fits, leave room for the archive name. */
+	if (cache_dir != NULL && strlen(cache_dir) >= LIBMPQ_CACHE_PATH / 2) {
+
+		/* path is too long. */
+		return LIBMPQ_ERROR_SIZE;
+	}
+
+	/* store directory, null disables the cache. */
+	strcpy(libmpq__cache_directory, cache_dir != NULL ? cache_dir : "");
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function builds the sidecar file name, the archive path is flattened into a single file name. */
+static int32_t libmpq__cache_path(char *path, const char *mpq_filename) {
+
+	/* some common variables. */
+	size_t length = strlen(libmpq__cache_directory);
+	size_t i;
+
+	/* check if cache is enabled and name fits. */
+	if (length == 0 || length + strlen(mpq_filename) + 16 >= LIBMPQ_CACHE_PATH) {
+
+		/* no usable cache path. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* copy directory and make sure it ends with a separator. */
+	strcpy(path, libmpq__cache_directory);
+	if (path[length - 1] != '/' && path[length - 1] != '\\') {
+		path[length++] = '/';
+	}
+
+	/* append archive path with separators replaced. */
+	for (i = 0; mpq_filename[i] != 0; i++) {
+		path[length++] = (mpq_filename[i] == '/' || mpq_filename[i] == '\\' || mpq_filename[i] == ':') ? '_' : mpq_filename[i];
+	}
+	strcpy(path + length, ".tables");
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function fills the sidecar header for the opened archive. */
+static int32_t libmpq__cache_header(mpq_archive_s *mpq_archive, mpq_cache_s *mpq_cache) {
+
+	/* some common variables. */
+	libmpq__stat_t st;
+
+	/* get size and modification time of the archive. */
+	if (libmpq__fstat(libmpq__fileno(mpq_archive->fp), &st) < 0) {
+
+		/* stat failed. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* fill header, padding is cleared so it can be compared with memcmp(). */
+	memset(mpq_cache, 0, sizeof(mpq_cache_s));
+	mpq_cache->magic          = LIBMPQ_CACHE_MAGIC;
+	mpq_cache->version        = LIBMPQ_CACHE_VERSION;
+	mpq_cache->file_size      = st.st_size;
+	mpq_cache->file_mtime     = st.st_mtime;
+	mpq_cache->archive_offset = mpq_archive->archive_offset;
+	mpq_cache->files          = mpq_archive->files;
+	mpq_cache->mpq_header     = mpq_archive->mpq_header;
+	mpq_cache->mpq_header_ex  = mpq_archive->mpq_header_ex;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function fills the tables from the sidecar file if it belongs to the unchanged archive. */
+static int32_t libmpq__cache_read(mpq_archive_s *mpq_archive, const char *mpq_filename) {
+
+	/* some common variables. */
+	char path[LIBMPQ_CACHE_PATH];
+	mpq_cache_s expected;
+	mpq_cache_s stored;
+	uint32_t blocks = mpq_archive->mpq_header.block_table_count;
+	uint32_t hashes = mpq_archive->mpq_header.hash_table_count;
+	int32_t result  = LIBMPQ_ERROR_READ;
+	FILE *fp;
+
+	/* check if cache is enabled and archive can be identified. */
+	if (libmpq__cache_path(path, mpq_filename) < 0 ||
+	    libmpq__cache_header(mpq_archive, &expected) < 0 ||
+	    (fp = fopen(path, "rb")) == NULL) {
+
+		/* no cached tables. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* the file count is only known after reading, so it is not compared. */
+	memset(&stored, 0, sizeof(mpq_cache_s));
+	if (fread(&stored, 1, sizeof(mpq_cache_s), fp) == sizeof(mpq_cache_s)) {
+		expected.files = stored.files;
+	}
+
+	/* compare header and read tables in the same order they were written. */
+	if (memcmp(&stored, &expected, sizeof(mpq_cache_s)) == 0 &&
+	    stored.files <= blocks &&
+	    fread(mpq_archive->mpq_hash, sizeof(mpq_hash_s), hashes, fp) == hashes &&
+	    fread(mpq_archive->mpq_block, sizeof(mpq_block_s), blocks, fp) == blocks &&
+	    fread(mpq_archive->mpq_block_ex, sizeof(mpq_block_ex_s), blocks, fp) == blocks &&
+	    fread(mpq_archive->mpq_map, sizeof(mpq_map_s), blocks, fp) == blocks) {
+
+		/* tables are valid. */
+		mpq_archive->files = stored.files;
+		result = LIBMPQ_SUCCESS;
+	}
+
+	/* close sidecar file. */
+	fclose(fp);
+
+	/* return read result. */
+	return result;
+}
+
+/* this function writes the decrypted tables to the sidecar file. */
+static int32_t libmpq__cache_write(mpq_archive_s *mpq_archive, const char *mpq_filename) {
+
+	/* some common variables. */
+	char path[LIBMPQ_CACHE_PATH];
+	char temp[LIBMPQ_CACHE_PATH + 8];
+	mpq_cache_s header;
+	uint32_t blocks = mpq_archive->mpq_header.block_table_count;
+	uint32_t hashes = mpq_archive->mpq_header.hash_table_count;
+	int32_t result  = LIBMPQ_ERROR_WRITE;
+	FILE *fp;
+
+	/* check if cache is enabled and archive can be identified. */
+	if (libmpq__cache_path(path, mpq_filename) < 0 ||
+	    libmpq__cache_header(mpq_archive, &header) < 0) {
+
+		/* nothing to write. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* write to a temporary name, so a reader never sees a partial file. */
+	sprintf(temp, "%s.tmp", path);
+	if ((fp = fopen(temp, "wb")) == NULL) {
+
+		/* directory is missing or not writable. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* write header and tables. */
+	if (fwrite(&header, 1, sizeof(mpq_cache_s), fp) == sizeof(mpq_cache_s) &&
+	    fwrite(mpq_archive->mpq_hash, sizeof(mpq_hash_s), hashes, fp) == hashes &&
+	    fwrite(mpq_archive->mpq_block, sizeof(mpq_block_s), blocks, fp) == blocks &&
+	    fwrite(mpq_archive->mpq_block_ex, sizeof(mpq_block_ex_s), blocks, fp) == blocks &&
+	    fwrite(mpq_archive->mpq_map, sizeof(mpq_map_s), blocks, fp) == blocks) {
+
+		/* all tables written. */
+		result = LIBMPQ_SUCCESS;
+	}
+
+	/* close and move into place. */
+	if (fclose(fp) != 0) {
+		result = LIBMPQ_ERROR_WRITE;
+	}
+	remove(path);
+	if (result < 0 || rename(temp, path) != 0) {
+
+		/* drop the incomplete file. */
+		remove(temp);
+		return LIBMPQ_ERROR_WRITE;
+	}
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function reads and decrypts the hash and block tables and builds the file number mapping. */
+static int32_t libmpq__archive_read_tables(mpq_archive_s *mpq_archive) {
+
+	/* some common variables. */
+	uint32_t rb    = 0;
+	uint32_t i     = 0;
+	uint32_t count = 0;
+
+	/* seek in file. */
+	if (fseeko(mpq_archive->fp, mpq_archive->mpq_header.hash_table_offset + (((long long)(mpq_archive->mpq_header_ex.hash_table_offset_high)) << 32) + mpq_archive->archive_offset, SEEK_SET) < 0) {
+
+		/* seek in file failed. */
+		return LIBMPQ_ERROR_SEEK;
+	}
+
+	/* read the hash table into the buffer. */
+	if ((rb = fread(mpq_archive->mpq_hash, 1, mpq_archive->mpq_header.hash_table_count * sizeof(mpq_hash_s), mpq_archive->fp)) < 0) {
+
+		/* something on read failed. */
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* decrypt the hashtable. */
+	libmpq__decrypt_block((uint32_t *)(mpq_archive->mpq_hash), mpq_archive->mpq_header.hash_table_count * sizeof(mpq_hash_s), libmpq__hash_string("(hash table)", 0x300));
+
+	/* seek in file. */
+	if (fseeko(mpq_archive->fp, mpq_archive->mpq_header.block_table_offset + (((long long)(mpq_archive->mpq_header_ex.block_table_offset_high)) << 32) + mpq_archive->archive_offset, SEEK_SET) < 0) {
+
+		/* seek in file failed. */
+		return LIBMPQ_ERROR_SEEK;
+	}
+
+	/* read the block table into the buffer. */
+	if ((rb = fread(mpq_archive->mpq_block, 1, mpq_archive->mpq_header.block_table_count * sizeof(mpq_block_s), mpq_archive->fp)) < 0) {
+
+		/* something on read failed. */
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* decrypt block table. */
+	libmpq__decrypt_block((uint32_t *)(mpq_archive->mpq_block), mpq_archive->mpq_header.block_table_count * sizeof(mpq_block_s), libmpq__hash_string("(block table)", 0x300));
+
+	/* check if extended block table is present, regardless of version 2 it is only present in archives > 4GB. */
+	if (mpq_archive->mpq_header_ex.extended_offset > 0) {
+
+		/* seek in file. */
+		if (fseeko(mpq_archive->fp, mpq_archive->mpq_header_ex.extended_offset + mpq_archive->archive_offset, SEEK_SET) < 0) {
+
+			/* seek in file failed. */
+			return LIBMPQ_ERROR_SEEK;
+		}
+
+		/* read header from file. */
+		if ((rb = fread(mpq_archive->mpq_block_ex, 1, mpq_archive->mpq_header.block_table_count * sizeof(mpq_block_ex_s), mpq_archive->fp)) < 0) {
+
+			/* no valid mpq archive. */
+			return LIBMPQ_ERROR_FORMAT;
+		}
+	}
+
+	/* loop through all files in mpq archive and check if they are valid. */
+	for (i = 0; i < mpq_archive->mpq_header.block_table_count; i++) {
+
+		/* save block difference between valid and invalid blocks. */
+		mpq_archive->mpq_map[i].block_table_diff = i - count;
+
+		/* check if file exists, sizes and offsets are correct. */
+		if ((mpq_archive->mpq_block[i].flags & LIBMPQ_FLAG_EXISTS) == 0) {
+
+			/* file does not exist, so nothing to do with that block. */
+			continue;
+		}
+
+		/* create final indices tables. */
+		mpq_archive->mpq_map[count].block_table_indices = i;
+
+		/* increase file counter. */
+		count++;
+	}
+
+	/* save the number of files. */
+	mpq_archive->files = count;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function opens the archive like libmpq__archive_open(), but allows selecting how blocks are read. */
+int32_t libmpq__archive_open_flags(mpq_archive_s **mpq_archive, const char *mpq_filename, libmpq__off_t archive_offset, uint32_t flags) {
+
 	/* some common variables. */
 	uint32_t rb             = 0;
-	uint32_t i              = 0;
-	uint32_t count          = 0;
 	int32_t result          = 0;
 	uint32_t header_search	= FALSE;
 
@@ -169,6 +567,7 @@ int32_t libmpq__archive_open(mpq_archive_s **mpq_archive, const char *mpq_filena
 	    ((*mpq_archive)->mpq_block_ex = calloc((*mpq_archive)->mpq_header.block_table_count, sizeof(mpq_block_ex_s))) == NULL ||
 	    ((*mpq_archive)->mpq_hash     = calloc((*mpq_archive)->mpq_header.hash_table_count,  sizeof(mpq_hash_s))) == NULL ||
 	    ((*mpq_archive)->mpq_file     = calloc((*mpq_archive)->mpq_header.block_table_count, sizeof(mpq_file_s))) == NULL ||
+	    ((*mpq_archive)->mpq_seed     = calloc((*mpq_archive)->mpq_header.block_table_count, sizeof(uint32_t))) == NULL ||
 	    ((*mpq_archive)->mpq_map      = calloc((*mpq_archive)->mpq_header.block_table_count, sizeof(mpq_map_s))) == NULL) {
 
 		/* memory allocation problem. */
@@ -176,87 +575,30 @@ int32_t libmpq__archive_open(mpq_archive_s **mpq_archive, const char *mpq_filena
 		goto error;
 	}
 
-	/* seek in file. */
-	if (fseeko((*mpq_archive)->fp, (*mpq_archive)->mpq_header.hash_table_offset + (((long long)((*mpq_archive)->mpq_header_ex.hash_table_offset_high)) << 32) + (*mpq_archive)->archive_offset, SEEK_SET) < 0) {
-
-		/* seek in file failed. */
-		result = LIBMPQ_ERROR_SEEK;
-		goto error;
-	}
-
-	/* read the hash table into the buffer. */
-	if ((rb = fread((*mpq_archive)->mpq_hash, 1, (*mpq_archive)->mpq_header.hash_table_count * sizeof(mpq_hash_s), (*mpq_archive)->fp)) < 0) {
-
-		/* something on read failed. */
-		result = LIBMPQ_ERROR_READ;
-		goto error;
-	}
-
-	/* decrypt the hashtable. */
-	libmpq__decrypt_block((uint32_t *)((*mpq_archive)->mpq_hash), (*mpq_archive)->mpq_header.hash_table_count * sizeof(mpq_hash_s), libmpq__hash_string("(hash table)", 0x300));
-
-	/* seek in file. */
-	if (fseeko((*mpq_archive)->fp, (*mpq_archive)->mpq_header.block_table_offset + (((long long)((*mpq_archive)->mpq_header_ex.block_table_offset_high)) << 32) + (*mpq_archive)->archive_offset, SEEK_SET) < 0) {
-
-		/* seek in file failed. */
-		result = LIBMPQ_ERROR_SEEK;
-		goto error;
-	}
-
-	/* read the block table into the buffer. */
-	if ((rb = fread((*mpq_archive)->mpq_block, 1, (*mpq_archive)->mpq_header.block_table_count * sizeof(mpq_block_s), (*mpq_archive)->fp)) < 0) {
-
-		/* something on read failed. */
-		result = LIBMPQ_ERROR_READ;
-		goto error;
-	}
-
-	/* decrypt block table. */
-	libmpq__decrypt_block((uint32_t *)((*mpq_archive)->mpq_block), (*mpq_archive)->mpq_header.block_table_count * sizeof(mpq_block_s), libmpq__hash_string("(block table)", 0x300));
-
-	/* check if extended block table is present, regardless of version 2 it is only present in archives > 4GB. */
-	if ((*mpq_archive)->mpq_header_ex.extended_offset > 0) {
+	/* use the tables from the sidecar cache if it is still valid, otherwise read them and refresh the cache. */
+	if (libmpq__cache_read(*mpq_archive, mpq_filename) != LIBMPQ_SUCCESS) {
 
-		/* seek in file. */
-		if (fseeko((*mpq_archive)->fp, (*mpq_archive)->mpq_header_ex.extended_offset + archive_offset, SEEK_SET) < 0) {
+		/* read and decrypt the tables. */
+		if ((result = libmpq__archive_read_tables(*mpq_archive)) < 0) {
 
-			/* seek in file failed. */
-			result = LIBMPQ_ERROR_SEEK;
+			/* something on reading the tables failed. */
 			goto error;
 		}
 
-		/* read header from file. */
-		if ((rb = fread((*mpq_archive)->mpq_block_ex, 1, (*mpq_archive)->mpq_header.block_table_count * sizeof(mpq_block_ex_s), (*mpq_archive)->fp)) < 0) {
-
-			/* no valid mpq archive. */
-			result = LIBMPQ_ERROR_FORMAT;
-			goto error;
-		}
+		/* store tables for the next open, failure only costs the next open some time. */
+		libmpq__cache_write(*mpq_archive, mpq_filename);
 	}
 
-	/* loop through all files in mpq archive and check if they are valid. */
-	for (i = 0; i < (*mpq_archive)->mpq_header.block_table_count; i++) {
+	/* initialize lock for the opened files. */
+	libmpq__mutex_init(&(*mpq_archive)->file_lock);
 
-		/* save block difference between valid and invalid blocks. */
-		(*mpq_archive)->mpq_map[i].block_table_diff = i - count;
+	/* check if the block reads should use a memory mapping. */
+	if ((flags & LIBMPQ_OPEN_MMAP) != 0) {
 
-		/* check if file exists, sizes and offsets are correct. */
-		if (((*mpq_archive)->mpq_block[i].flags & LIBMPQ_FLAG_EXISTS) == 0) {
-
-			/* file does not exist, so nothing to do with that block. */
-			continue;
-		}
-
-		/* create final indices tables. */
-		(*mpq_archive)->mpq_map[count].block_table_indices = i;
-
-		/* increase file counter. */
-		count++;
+		/* map the archive, if this fails we silently use stdio reads. */
+		libmpq__archive_map(*mpq_archive);
 	}
 
-	/* save the number of files. */
-	(*mpq_archive)->files = count;
-
 	/* if no error was found, return zero. */
 	return LIBMPQ_SUCCESS;
 
@@ -265,6 +607,7 @@ error:
 		fclose((*mpq_archive)->fp);
 
 	free((*mpq_archive)->mpq_map);
+	free((*mpq_archive)->mpq_seed);
 	free((*mpq_archive)->mpq_file);
 	free((*mpq_archive)->mpq_hash);
 	free((*mpq_archive)->mpq_block);
@@ -279,6 +622,9 @@ error:
 /* this function close the file descriptor, free the decryption buffer and the file list. */
 int32_t libmpq__archive_close(mpq_archive_s *mpq_archive) {
 
+	/* release the mapping before the file is closed. */
+	libmpq__archive_unmap(mpq_archive);
+
 	/* try to close the file */
 	if ((fclose(mpq_archive->fp)) < 0) {
 
@@ -288,8 +634,11 @@ int32_t libmpq__archive_close(mpq_archive_s *mpq_archive) {
 		return LIBMPQ_ERROR_CLOSE;
 	}
 
-	/* free header, tables and list. */
+	/* free lock, header, tables and list. */
+	libmpq__mutex_destroy(&mpq_archive->file_lock);
 	free(mpq_archive->mpq_map);
+	free(mpq_archive->mpq_seed);
+	free(mpq_archive->mpq_attributes);
 	free(mpq_archive->mpq_file);
 	free(mpq_archive->mpq_hash);
 	free(mpq_archive->mpq_block);
@@ -360,6 +709,71 @@ int32_t libmpq__archive_files(mpq_archive_s *mpq_archive, uint32_t *files) {
 	return LIBMPQ_SUCCESS;
 }
 
+/* this function return if the archive blocks are read from a memory mapping. */
+int32_t libmpq__archive_mapped(mpq_archive_s *mpq_archive, uint32_t *mapped) {
+
+	/* return mapping status. */
+	*mapped = mpq_archive->map != NULL ? TRUE : FALSE;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function return the number of entries in the hash table. */
+int32_t libmpq__archive_hashes(mpq_archive_s *mpq_archive, uint32_t *hashes) {
+
+	/* return hash table size. */
+	*hashes = mpq_archive->mpq_header.hash_table_count;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function return the name hashes, locale and file number stored in the given hash table entry. */
+int32_t libmpq__hash_entry(mpq_archive_s *mpq_archive, uint32_t hash_number, uint32_t *hash_a, uint32_t *hash_b, uint16_t *locale, uint32_t *file_number) {
+
+	/* some common variables. */
+	uint32_t block_table_index;
+
+	/* check if given hash number is not out of range. */
+	if (hash_number >= mpq_archive->mpq_header.hash_table_count) {
+
+		/* hash number is out of range. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* get the block the entry points to. */
+	block_table_index = mpq_archive->mpq_hash[hash_number].block_table_index;
+
+	/* check if entry is free, deleted or points to a missing block. */
+	if (block_table_index >= mpq_archive->mpq_header.block_table_count ||
+	    (mpq_archive->mpq_block[block_table_index].flags & LIBMPQ_FLAG_EXISTS) == 0) {
+
+		/* no file behind this entry. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* return the entry information. */
+	*hash_a      = mpq_archive->mpq_hash[hash_number].hash_a;
+	*hash_b      = mpq_archive->mpq_hash[hash_number].hash_b;
+	*locale      = mpq_archive->mpq_hash[hash_number].locale;
+	*file_number = block_table_index - mpq_archive->mpq_map[block_table_index].block_table_diff;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
+/* this function return the two name hashes which identify the given file name in every hash table. */
+int32_t libmpq__hash_name(const char *filename, uint32_t *hash_a, uint32_t *hash_b) {
+
+	/* compute the same hashes libmpq__file_number compares. */
+	*hash_a = libmpq__hash_string(filename, 0x100);
+	*hash_b = libmpq__hash_string(filename, 0x200);
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
 /* this function return the packed size of the given files in the archive. */
 int32_t libmpq__file_packed_size(mpq_archive_s *mpq_archive, uint32_t file_number, libmpq__off_t *packed_size) {
 
@@ -411,6 +825,51 @@ int32_t libmpq__file_offset(mpq_archive_s *mpq_archive, uint32_t file_number, li
 	return LIBMPQ_SUCCESS;
 }
 
+/* this function return a pointer to the file data inside the archive mapping, only possible for stored files which are neither compressed nor encrypted. */
+int32_t libmpq__file_pointer(mpq_archive_s *mpq_archive, uint32_t file_number, const uint8_t **data, libmpq__off_t *size) {
+
+	/* some common variables. */
+	mpq_block_s *mpq_block;
+	libmpq__off_t offset = 0;
+
+	/* check if given file number is not out of range. */
+	if (file_number < 0 || file_number > mpq_archive->files - 1) {
+
+		/* file number is out of range. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* get block of file. */
+	mpq_block = &mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices];
+
+	/* check if archive is mapped and file bytes are stored as they are. */
+	if (mpq_archive->map == NULL ||
+	    (mpq_block->flags & (LIBMPQ_FLAG_COMPRESSED | LIBMPQ_FLAG_ENCRYPTED)) != 0 ||
+	    mpq_block->packed_size < mpq_block->unpacked_size) {
+
+		/* file must be read with libmpq__file_read(). */
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* get absolute file position. */
+	libmpq__file_offset(mpq_archive, file_number, &offset);
+	offset += mpq_archive->archive_offset;
+
+	/* check if file is inside the mapping. */
+	if ((uint64_t)offset + mpq_block->unpacked_size > mpq_archive->map_size) {
+
+		/* archive is truncated. */
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* return pointer and size. */
+	*data = mpq_archive->map + offset;
+	*size = mpq_block->unpacked_size;
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
 /* this function return the number of blocks for the given file in the archive. */
 int32_t libmpq__file_blocks(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t *blocks) {
 
@@ -600,14 +1059,194 @@ int32_t libmpq__file_read(mpq_archive_s *mpq_archive, uint32_t file_number, uint
 	return LIBMPQ_SUCCESS;
 }
 
-/* this function open a file in the given archive and caches the block offset information. */
-int32_t libmpq__block_open_offset(mpq_archive_s *mpq_archive, uint32_t file_number) {
+/* this function loads the (attributes) file once, later calls only return what the first one found. */
+static int32_t libmpq__attributes_load(mpq_archive_s *mpq_archive) {
+
+	/* some common variables. */
+	uint8_t *attributes_buf   = NULL;
+	uint32_t attributes_state = 2;
+	uint32_t file_number      = 0;
+	uint32_t flags            = 0;
+	uint32_t required         = LIBMPQ_ATTRIBUTES_HEADER;
+	uint32_t count            = mpq_archive->mpq_header.block_table_count;
+	libmpq__off_t size        = 0;
+
+	/* check if another call already loaded it. */
+	libmpq__mutex_lock(&mpq_archive->file_lock);
+	attributes_state = mpq_archive->attributes_state;
+	libmpq__mutex_unlock(&mpq_archive->file_lock);
+	if (attributes_state != 0) {
+		return attributes_state == 1 ? LIBMPQ_SUCCESS : LIBMPQ_ERROR_EXIST;
+	}
+
+	/* read the file, this takes the file lock itself. */
+	attributes_state = 2;
+	if (libmpq__file_number(mpq_archive, LIBMPQ_ATTRIBUTES_NAME, &file_number) == 0 &&
+	    libmpq__file_unpacked_size(mpq_archive, file_number, &size) == 0 &&
+	    size >= LIBMPQ_ATTRIBUTES_HEADER &&
+	    (attributes_buf = malloc(size)) != NULL &&
+	    libmpq__file_read(mpq_archive, file_number, attributes_buf, size, NULL) == 0) {
+
+		/* check that every array announced by the flags is complete. */
+		flags = ((uint32_t *)attributes_buf)[1];
+		required += (flags & LIBMPQ_ATTRIBUTES_CRC32) ? count * 4 : 0;
+		required += (flags & LIBMPQ_ATTRIBUTES_FILETIME) ? count * 8 : 0;
+		required += (flags & LIBMPQ_ATTRIBUTES_MD5) ? count * 16 : 0;
+		attributes_state = size >= required ? 1 : 2;
+	}
+
+	/* publish the result unless another thread was faster. */
+	libmpq__mutex_lock(&mpq_archive->file_lock);
+	if (mpq_archive->attributes_state == 0) {
+		mpq_archive->mpq_attributes   = attributes_state == 1 ? attributes_buf : NULL;
+		mpq_archive->attributes_size  = attributes_state == 1 ? (uint32_t)size : 0;
+		mpq_archive->attributes_state = attributes_state;
+		if (attributes_state == 1) {
+			attributes_buf = NULL;
+		}
+	}
+	attributes_state = mpq_archive->attributes_state;
+	libmpq__mutex_unlock(&mpq_archive->file_lock);
+
+	/* free the buffer if it was not used. */
+	free(attributes_buf);
+
+	/* return if checksums are available. */
+	return attributes_state == 1 ? LIBMPQ_SUCCESS : LIBMPQ_ERROR_EXIST;
+}
+
+/* this function reads every block of the given file and compares the result against its (attributes) checksums. */
+int32_t libmpq__file_verify(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t *checked) {
+
+	/* some common variables. */
+	uint32_t i;
+	uint32_t blocks      = 0;
+	uint32_t flags       = 0;
+	uint32_t block_index = 0;
+	uint32_t count       = mpq_archive->mpq_header.block_table_count;
+	uint32_t expect_crc  = 0;
+	uint32_t crc         = 0;
+	uint8_t expect_md5[16];
+	uint8_t md5[16];
+	uint8_t *out_buf     = NULL;
+	uint8_t *table       = NULL;
+	int32_t result       = 0;
+	libmpq__off_t unpacked_size = 0;
+	libmpq__off_t transferred   = 0;
+	md5_ctx_s md5_ctx;
+
+	/* check if given file number is not out of range. */
+	if (file_number < 0 || file_number > mpq_archive->files - 1) {
+
+		/* file number is out of range. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* fetch the expected checksums, without (attributes) the file is only decompressed. */
+	*checked = 0;
+	memset(expect_md5, 0, sizeof(expect_md5));
+	if (libmpq__attributes_load(mpq_archive) == 0) {
+		block_index = mpq_archive->mpq_map[file_number].block_table_indices;
+		flags       = ((uint32_t *)mpq_archive->mpq_attributes)[1];
+		table       = mpq_archive->mpq_attributes + LIBMPQ_ATTRIBUTES_HEADER;
+
+		/* crc32 array comes first, zero means no checksum was stored. */
+		if (flags & LIBMPQ_ATTRIBUTES_CRC32) {
+			expect_crc = ((uint32_t *)table)[block_index];
+			table     += count * 4;
+		}
+
+		/* file times are not checked. */
+		if (flags & LIBMPQ_ATTRIBUTES_FILETIME) {
+			table += count * 8;
+		}
+
+		/* md5 array is last, all zeros means no checksum was stored. */
+		if (flags & LIBMPQ_ATTRIBUTES_MD5) {
+			memcpy(expect_md5, table + block_index * 16, 16);
+		}
+	}
+
+	/* open the packed block offset table. */
+	if ((result = libmpq__block_open_offset(mpq_archive, file_number)) < 0) {
+
+		/* something on opening packed block offset table failed. */
+		return result;
+	}
+
+	/* get block count and the largest block, which is always the first one. */
+	libmpq__file_blocks(mpq_archive, file_number, &blocks);
+	libmpq__block_unpacked_size(mpq_archive, file_number, 0, &unpacked_size);
+
+	/* allocate memory for one block. */
+	if ((out_buf = malloc(unpacked_size > 0 ? unpacked_size : 1)) == NULL) {
+
+		/* memory allocation problem. */
+		libmpq__block_close_offset(mpq_archive, file_number);
+		return LIBMPQ_ERROR_MALLOC;
+	}
+
+	/* read and hash all blocks. */
+	crc = crc32(0L, Z_NULL, 0);
+	libmpq__md5_init(&md5_ctx);
+	for (i = 0; i < blocks; i++) {
+
+		/* get unpacked block size. */
+		libmpq__block_unpacked_size(mpq_archive, file_number, i, &unpacked_size);
+
+		/* read block. */
+		if ((result = libmpq__block_read(mpq_archive, file_number, i, out_buf, unpacked_size, &transferred)) < 0) {
+
+			/* something on reading block failed. */
+			libmpq__block_close_offset(mpq_archive, file_number);
+			goto error;
+		}
+
+		/* hash block. */
+		crc = crc32(crc, out_buf, (uInt)transferred);
+		libmpq__md5_update(&md5_ctx, out_buf, (uint32_t)transferred);
+	}
+	libmpq__md5_final(&md5_ctx, md5);
+
+	/* close the packed block offset table. */
+	libmpq__block_close_offset(mpq_archive, file_number);
+
+	/* compare checksums. */
+	if ((flags & LIBMPQ_ATTRIBUTES_CRC32) && expect_crc != 0) {
+		*checked |= LIBMPQ_ATTRIBUTES_CRC32;
+		if (crc != expect_crc) {
+			result = LIBMPQ_ERROR_CHECKSUM;
+		}
+	}
+	if (flags & LIBMPQ_ATTRIBUTES_MD5) {
+		for (i = 0; i < 16 && expect_md5[i] == 0; i++);
+		if (i < 16) {
+			*checked |= LIBMPQ_ATTRIBUTES_MD5;
+			if (memcmp(md5, expect_md5, 16) != 0) {
+				result = LIBMPQ_ERROR_CHECKSUM;
+			}
+		}
+	}
+
+error:
+
+	/* free buffer. */
+	free(out_buf);
+
+	/* return result of the reads and the comparison. */
+	return result;
+}
+
+/* this function open a file in the given archive and caches the block offset information, the caller must hold the file lock. */
+static int32_t libmpq__block_open_offset_locked(mpq_archive_s *mpq_archive, uint32_t file_number) {
 
 	/* some common variables. */
 	uint32_t i;
 	uint32_t packed_size;
 	int32_t rb     = 0;
 	int32_t result = 0;
+	uint64_t start;
+	libmpq__off_t block_offset = 0;
 
 	/* check if given file number is not out of range. */
 	if (file_number < 0 || file_number > mpq_archive->files - 1) {
@@ -664,20 +1303,32 @@ int32_t libmpq__block_open_offset(mpq_archive_s *mpq_archive, uint32_t file_numb
 	if ((mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].flags & LIBMPQ_FLAG_COMPRESSED) != 0 &&
 	    (mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].flags & LIBMPQ_FLAG_SINGLE) == 0) {
 
-		/* seek to block position. */
-		if (fseeko(mpq_archive->fp, mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].offset + (((long long)mpq_archive->mpq_block_ex[mpq_archive->mpq_map[file_number].block_table_indices].offset_high) << 32) + mpq_archive->archive_offset, SEEK_SET) < 0) {
+		/* fetch absolute position of the block offset table. */
+		block_offset = mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].offset + (((long long)mpq_archive->mpq_block_ex[mpq_archive->mpq_map[file_number].block_table_indices].offset_high) << 32) + mpq_archive->archive_offset;
 
-			/* seek in file failed. */
-			result = LIBMPQ_ERROR_SEEK;
-			goto error;
-		}
+		/* check if archive is mapped, then we copy the table from the mapping. */
+		if (mpq_archive->map != NULL) {
 
-		/* read block positions from begin of file. */
-		if ((rb = fread(mpq_archive->mpq_file[file_number]->packed_offset, 1, packed_size, mpq_archive->fp)) < 0) {
+			/* check if table is inside the mapping. */
+			if (block_offset < 0 || (uint64_t)block_offset + packed_size > mpq_archive->map_size) {
 
-			/* something on read from archive failed. */
-			result = LIBMPQ_ERROR_READ;
-			goto error;
+				/* something on read from archive failed. */
+				result = LIBMPQ_ERROR_READ;
+				goto error;
+			}
+
+			/* copy block positions from begin of file. */
+			memcpy(mpq_archive->mpq_file[file_number]->packed_offset, mpq_archive->map + block_offset, packed_size);
+			rb = packed_size;
+		} else {
+
+			/* read block positions from begin of file. */
+			if ((rb = libmpq__archive_pread(mpq_archive, mpq_archive->mpq_file[file_number]->packed_offset, packed_size, block_offset)) < 0) {
+
+				/* something on read from archive failed. */
+				result = LIBMPQ_ERROR_READ;
+				goto error;
+			}
 		}
 
 		/* check if the archive is protected some way, sometimes the file appears not to be encrypted, but it is. */
@@ -690,12 +1341,13 @@ int32_t libmpq__block_open_offset(mpq_archive_s *mpq_archive, uint32_t file_numb
 		/* check if packed offset block is encrypted, we have to decrypt it. */
 		if (mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].flags & LIBMPQ_FLAG_ENCRYPTED) {
 
-			/* check if we don't know the file seed, try to find it. */
-			if ((mpq_archive->mpq_file[file_number]->seed = libmpq__decrypt_key((uint8_t *)mpq_archive->mpq_file[file_number]->packed_offset, packed_size, mpq_archive->block_size)) < 0) {
+			/* check if we derived the file seed on an earlier open. */
+			if ((mpq_archive->mpq_file[file_number]->seed = mpq_archive->mpq_seed[file_number]) == 0) {
 
-				/* sorry without seed, we cannot extract file. */
-				result = LIBMPQ_ERROR_DECRYPT;
-				goto error;
+				/* we don't know the file seed, try to find it. */
+				start = libmpq__stats_start();
+				mpq_archive->mpq_file[file_number]->seed = libmpq__decrypt_key((uint8_t *)mpq_archive->mpq_file[file_number]->packed_offset, packed_size, mpq_archive->block_size);
+				libmpq__stats_add(LIBMPQ_STATS_KEY, packed_size, packed_size, start);
 			}
 
 			/* decrypt block in input buffer. */
@@ -706,13 +1358,16 @@ int32_t libmpq__block_open_offset(mpq_archive_s *mpq_archive, uint32_t file_numb
 				goto error;
 			}
 
-			/* check if the block positions are correctly decrypted. */
+			/* check if the block positions are correctly decrypted, this also catches a failed key search. */
 			if (mpq_archive->mpq_file[file_number]->packed_offset[0] != packed_size) {
 
 				/* sorry without seed, we cannot extract file. */
 				result = LIBMPQ_ERROR_DECRYPT;
 				goto error;
 			}
+
+			/* remember the seed for the next open. */
+			mpq_archive->mpq_seed[file_number] = mpq_archive->mpq_file[file_number]->seed;
 		}
 	} else {
 
@@ -750,12 +1405,30 @@ error:
 	free(mpq_archive->mpq_file[file_number]->packed_offset);
 	free(mpq_archive->mpq_file[file_number]);
 
+	/* mark it as unopened, so a later open does not reuse the freed pointer. */
+	mpq_archive->mpq_file[file_number] = NULL;
+
 	/* return error constant. */
 	return result;
 }
 
-/* this function free the file pointer to the opened file in archive. */
-int32_t libmpq__block_close_offset(mpq_archive_s *mpq_archive, uint32_t file_number) {
+/* this function open a file in the given archive and caches the block offset information. */
+int32_t libmpq__block_open_offset(mpq_archive_s *mpq_archive, uint32_t file_number) {
+
+	/* some common variables. */
+	int32_t result;
+
+	/* several threads may open the same file at once. */
+	libmpq__mutex_lock(&mpq_archive->file_lock);
+	result = libmpq__block_open_offset_locked(mpq_archive, file_number);
+	libmpq__mutex_unlock(&mpq_archive->file_lock);
+
+	/* return the open result. */
+	return result;
+}
+
+/* this function free the file pointer to the opened file in archive, the caller must hold the file lock. */
+static int32_t libmpq__block_close_offset_locked(mpq_archive_s *mpq_archive, uint32_t file_number) {
 
 	/* check if given file number is not out of range. */
 	if (file_number < 0 || file_number > mpq_archive->files - 1) {
@@ -789,6 +1462,21 @@ int32_t libmpq__block_close_offset(mpq_archive_s *mpq_archive, uint32_t file_num
 	return LIBMPQ_SUCCESS;
 }
 
+/* this function free the file pointer to the opened file in archive. */
+int32_t libmpq__block_close_offset(mpq_archive_s *mpq_archive, uint32_t file_number) {
+
+	/* some common variables. */
+	int32_t result;
+
+	/* the open counter is shared with other reading threads. */
+	libmpq__mutex_lock(&mpq_archive->file_lock);
+	result = libmpq__block_close_offset_locked(mpq_archive, file_number);
+	libmpq__mutex_unlock(&mpq_archive->file_lock);
+
+	/* return the close result. */
+	return result;
+}
+
 /* this function return the unpacked size of the given file and block in the archive. */
 int32_t libmpq__block_unpacked_size(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t block_number, libmpq__off_t *unpacked_size) {
 
@@ -840,6 +1528,38 @@ int32_t libmpq__block_unpacked_size(mpq_archive_s *mpq_archive, uint32_t file_nu
 	return LIBMPQ_SUCCESS;
 }
 
+/* this function return the packed size of the given file and block in the archive. */
+int32_t libmpq__block_packed_size(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t block_number, libmpq__off_t *packed_size) {
+
+	/* check if given file number is not out of range. */
+	if (file_number < 0 || file_number > mpq_archive->files - 1) {
+
+		/* file number is out of range. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* check if given block number is not out of range. */
+	if (block_number < 0 || block_number >= ((mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].flags & LIBMPQ_FLAG_SINGLE) != 0 ? 1 : (mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].unpacked_size + mpq_archive->block_size - 1) / mpq_archive->block_size)) {
+
+		/* file number is out of range. */
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* check if packed block offset table is opened. */
+	if (mpq_archive->mpq_file[file_number] == NULL ||
+	    mpq_archive->mpq_file[file_number]->packed_offset == NULL) {
+
+		/* packed block offset table is not opened. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* return the distance to the next block offset, which is what libmpq__block_read() reads from disk. */
+	*packed_size = mpq_archive->mpq_file[file_number]->packed_offset[block_number + 1] - mpq_archive->mpq_file[file_number]->packed_offset[block_number];
+
+	/* if no error was found, return zero. */
+	return LIBMPQ_SUCCESS;
+}
+
 /* this function return the decryption seed for the given file and block. */
 int32_t libmpq__block_seed(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t block_number, uint32_t *seed) {
 
@@ -877,8 +1597,11 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 
 	/* some common variables. */
 	uint8_t *in_buf;
+	uint8_t *alloc_buf  = NULL;
+	uint8_t stack_buf[LIBMPQ_STACK_BLOCK_SIZE];
 	uint32_t seed       = 0;
 	uint32_t encrypted  = 0;
+	uint64_t start      = 0;
 	uint32_t compressed = 0;
 	uint32_t imploded   = 0;
 	int32_t tb          = 0;
@@ -922,32 +1645,69 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 	block_offset = mpq_archive->mpq_block[mpq_archive->mpq_map[file_number].block_table_indices].offset + (((long long)mpq_archive->mpq_block_ex[mpq_archive->mpq_map[file_number].block_table_indices].offset_high) << 32) + mpq_archive->mpq_file[file_number]->packed_offset[block_number];
 	in_size = mpq_archive->mpq_file[file_number]->packed_offset[block_number + 1] - mpq_archive->mpq_file[file_number]->packed_offset[block_number];
 
-	/* seek in file. */
-	if (fseeko(mpq_archive->fp, block_offset + mpq_archive->archive_offset, SEEK_SET) < 0) {
+	/* get encryption status. */
+	libmpq__file_encrypted(mpq_archive, file_number, &encrypted);
 
-		/* something with seek in file failed. */
-		return LIBMPQ_ERROR_SEEK;
-	}
+	/* check if archive is mapped, then we decompress straight from the mapping. */
+	if (mpq_archive->map != NULL) {
 
-	/* allocate memory for the read buffer. */
-	if ((in_buf = calloc(1, in_size)) == NULL) {
+		/* check if block is inside the mapping. */
+		if (block_offset + mpq_archive->archive_offset < 0 || (uint64_t)(block_offset + mpq_archive->archive_offset) + in_size > mpq_archive->map_size) {
 
-		/* memory allocation problem. */
-		return LIBMPQ_ERROR_MALLOC;
-	}
+			/* something on reading block failed. */
+			return LIBMPQ_ERROR_READ;
+		}
 
-	/* read block from file. */
-	if (fread(in_buf, 1, in_size, mpq_archive->fp) < 0) {
+		/* use the mapped block as input buffer. */
+		in_buf = mpq_archive->map + block_offset + mpq_archive->archive_offset;
 
-		/* free buffers. */
-		free(in_buf);
+		/* check if file is encrypted, the mapping is read only so we need a private copy. */
+		if (encrypted == 1) {
 
-		/* something on reading block failed. */
-		return LIBMPQ_ERROR_READ;
-	}
+			/* small blocks are decrypted on the stack, only large single sector files need the heap. */
+			if (in_size <= LIBMPQ_STACK_BLOCK_SIZE) {
 
-	/* get encryption status. */
-	libmpq__file_encrypted(mpq_archive, file_number, &encrypted);
+				/* use stack buffer. */
+				memcpy(stack_buf, in_buf, in_size);
+				in_buf = stack_buf;
+			} else {
+
+				/* allocate memory for the read buffer. */
+				if ((alloc_buf = malloc(in_size)) == NULL) {
+
+					/* memory allocation problem. */
+					return LIBMPQ_ERROR_MALLOC;
+				}
+
+				/* copy block. */
+				memcpy(alloc_buf, in_buf, in_size);
+				in_buf = alloc_buf;
+			}
+		}
+	} else {
+
+		/* allocate memory for the read buffer. */
+		if ((alloc_buf = calloc(1, in_size)) == NULL) {
+
+			/* memory allocation problem. */
+			return LIBMPQ_ERROR_MALLOC;
+		}
+
+		/* read block from file, this does not touch the shared file position. */
+		start = libmpq__stats_start();
+		if (libmpq__archive_pread(mpq_archive, alloc_buf, in_size, block_offset + mpq_archive->archive_offset) < 0) {
+
+			/* free buffers. */
+			free(alloc_buf);
+
+			/* something on reading block failed. */
+			return LIBMPQ_ERROR_READ;
+		}
+		libmpq__stats_add(LIBMPQ_STATS_READ, in_size, in_size, start);
+
+		/* use the read buffer as input buffer. */
+		in_buf = alloc_buf;
+	}
 
 	/* check if file is encrypted. */
 	if (encrypted == 1) {
@@ -956,14 +1716,16 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 		libmpq__block_seed(mpq_archive, file_number, block_number, &seed);
 
 		/* decrypt block. */
+		start = libmpq__stats_start();
 		if (libmpq__decrypt_block((uint32_t *)in_buf, in_size, seed) < 0) {
 
 			/* free buffers. */
-			free(in_buf);
+			free(alloc_buf);
 
 			/* something on decrypting block failed. */
 			return LIBMPQ_ERROR_DECRYPT;
 		}
+		libmpq__stats_add(LIBMPQ_STATS_DECRYPT, in_size, in_size, start);
 	}
 
 	/* get compression status. */
@@ -976,7 +1738,7 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 		if ((tb = libmpq__decompress_block(in_buf, in_size, out_buf, out_size, LIBMPQ_FLAG_COMPRESS_MULTI)) < 0) {
 
 			/* free temporary buffer. */
-			free(in_buf);
+			free(alloc_buf);
 
 			/* something on decompressing block failed. */
 			return LIBMPQ_ERROR_UNPACK;
@@ -993,7 +1755,7 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 		if ((tb = libmpq__decompress_block(in_buf, in_size, out_buf, out_size, LIBMPQ_FLAG_COMPRESS_PKZIP)) < 0) {
 
 			/* free temporary buffer. */
-			free(in_buf);
+			free(alloc_buf);
 
 			/* something on decompressing block failed. */
 			return LIBMPQ_ERROR_UNPACK;
@@ -1007,7 +1769,7 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 		if ((tb = libmpq__decompress_block(in_buf, in_size, out_buf, out_size, LIBMPQ_FLAG_COMPRESS_NONE)) < 0) {
 
 			/* free temporary buffer. */
-			free(in_buf);
+			free(alloc_buf);
 
 			/* something on decompressing block failed. */
 			return LIBMPQ_ERROR_UNPACK;
@@ -1015,7 +1777,7 @@ int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uin
 	}
 
 	/* free read buffer. */
-	free(in_buf);
+	free(alloc_buf);
 
 	/* check for null pointer. */
 	if (transferred != NULL) {
@@ -55,6 +55,14 @@ extern "C" {
 #define LIBMPQ_ERROR_EXIST			-10		/* file or block does not exist in archive. */
 #define LIBMPQ_ERROR_DECRYPT			-11		/* we don't know the decryption seed. */
 #define LIBMPQ_ERROR_UNPACK			-12		/* error on unpacking file. */
+#define LIBMPQ_ERROR_CHECKSUM			-13		/* file does not match its (attributes) checksum. */
+
+/* define flags for libmpq__archive_open_flags(). */
+#define LIBMPQ_OPEN_MMAP			0x00000001	/* map the whole archive and decompress blocks straight from the mapping. */
+
+/* define checksums reported by libmpq__file_verify(), the values are the (attributes) flags. */
+#define LIBMPQ_ATTRIBUTES_CRC32			0x00000001	/* crc32 of the unpacked file. */
+#define LIBMPQ_ATTRIBUTES_MD5			0x00000004	/* md5 of the unpacked file. */
 
 /* internal data structure. */
 typedef struct mpq_archive mpq_archive_s;
@@ -65,14 +73,24 @@ typedef int64_t libmpq__off_t;
 /* generic information about library. */
 extern LIBMPQ_API const char *libmpq__version(void);
 
+/* sidecar cache of decrypted archive tables, disabled while no directory is set. */
+extern LIBMPQ_API int32_t libmpq__cache_dir(const char *cache_dir);
+
 /* generic mpq archive information. */
 extern LIBMPQ_API int32_t libmpq__archive_open(mpq_archive_s **mpq_archive, const char *mpq_filename, libmpq__off_t archive_offset);
+extern LIBMPQ_API int32_t libmpq__archive_open_flags(mpq_archive_s **mpq_archive, const char *mpq_filename, libmpq__off_t archive_offset, uint32_t flags);
 extern LIBMPQ_API int32_t libmpq__archive_close(mpq_archive_s *mpq_archive);
 extern LIBMPQ_API int32_t libmpq__archive_packed_size(mpq_archive_s *mpq_archive, libmpq__off_t *packed_size);
 extern LIBMPQ_API int32_t libmpq__archive_unpacked_size(mpq_archive_s *mpq_archive, libmpq__off_t *unpacked_size);
 extern LIBMPQ_API int32_t libmpq__archive_offset(mpq_archive_s *mpq_archive, libmpq__off_t *offset);
 extern LIBMPQ_API int32_t libmpq__archive_version(mpq_archive_s *mpq_archive, uint32_t *version);
 extern LIBMPQ_API int32_t libmpq__archive_files(mpq_archive_s *mpq_archive, uint32_t *files);
+extern LIBMPQ_API int32_t libmpq__archive_mapped(mpq_archive_s *mpq_archive, uint32_t *mapped);
+extern LIBMPQ_API int32_t libmpq__archive_hashes(mpq_archive_s *mpq_archive, uint32_t *hashes);
+
+/* generic hash table functions. */
+extern LIBMPQ_API int32_t libmpq__hash_entry(mpq_archive_s *mpq_archive, uint32_t hash_number, uint32_t *hash_a, uint32_t *hash_b, uint16_t *locale, uint32_t *file_number);
+extern LIBMPQ_API int32_t libmpq__hash_name(const char *filename, uint32_t *hash_a, uint32_t *hash_b);
 
 /* generic file processing functions. */
 extern LIBMPQ_API int32_t libmpq__file_packed_size(mpq_archive_s *mpq_archive, uint32_t file_number, libmpq__off_t *packed_size);
@@ -84,13 +102,23 @@ extern LIBMPQ_API int32_t libmpq__file_compressed(mpq_archive_s *mpq_archive, ui
 extern LIBMPQ_API int32_t libmpq__file_imploded(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t *imploded);
 extern LIBMPQ_API int32_t libmpq__file_number(mpq_archive_s *mpq_archive, const char *filename, uint32_t *number);
 extern LIBMPQ_API int32_t libmpq__file_read(mpq_archive_s *mpq_archive, uint32_t file_number, uint8_t *out_buf, libmpq__off_t out_size, libmpq__off_t *transferred);
+extern LIBMPQ_API int32_t libmpq__file_pointer(mpq_archive_s *mpq_archive, uint32_t file_number, const uint8_t **data, libmpq__off_t *size);
+extern LIBMPQ_API int32_t libmpq__file_verify(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t *checked);
 
 /* generic block processing functions. */
 extern LIBMPQ_API int32_t libmpq__block_open_offset(mpq_archive_s *mpq_archive, uint32_t file_number);
 extern LIBMPQ_API int32_t libmpq__block_close_offset(mpq_archive_s *mpq_archive, uint32_t file_number);
 extern LIBMPQ_API int32_t libmpq__block_unpacked_size(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t block_number, libmpq__off_t *unpacked_size);
+extern LIBMPQ_API int32_t libmpq__block_packed_size(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t block_number, libmpq__off_t *packed_size);
 extern LIBMPQ_API int32_t libmpq__block_read(mpq_archive_s *mpq_archive, uint32_t file_number, uint32_t block_number, uint8_t *out_buf, libmpq__off_t out_size, libmpq__off_t *transferred);
 
+/* decompression statistics per codec, collected while timing is enabled. */
+extern LIBMPQ_API int32_t libmpq__codec_timing(uint32_t enable);
+extern LIBMPQ_API int32_t libmpq__codec_stats(uint32_t codec_number, const char **name, uint64_t *calls, uint64_t *in_bytes, uint64_t *out_bytes, uint64_t *nanoseconds);
+
+/* selects the bit by bit huffman and pkzip decoders the fast ones replaced, to compare their output. */
+extern LIBMPQ_API int32_t libmpq__codec_reference(uint32_t enable);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,48 @@
 
 #ifdef _MSC_VER
   #define fseeko _fseeki64
+  #define libmpq__fileno _fileno
+  #define libmpq__fstat _fstat64
+  typedef struct _stat64 libmpq__stat_t;
+#else
+  #define libmpq__fileno fileno
+  #define libmpq__fstat fstat
+  typedef struct stat libmpq__stat_t;
+#endif
+
+/* locking used to share one archive between several reading threads. */
+#ifdef _WIN32
+  #include <windows.h>
+  typedef CRITICAL_SECTION libmpq__mutex_t;
+  #define libmpq__mutex_init(m)		InitializeCriticalSection(m)
+  #define libmpq__mutex_destroy(m)	DeleteCriticalSection(m)
+  #define libmpq__mutex_lock(m)		EnterCriticalSection(m)
+  #define libmpq__mutex_unlock(m)	LeaveCriticalSection(m)
+#else
+  #include <pthread.h>
+  typedef pthread_mutex_t libmpq__mutex_t;
+  #define libmpq__mutex_init(m)		pthread_mutex_init(m, NULL)
+  #define libmpq__mutex_destroy(m)	pthread_mutex_destroy(m)
+  #define libmpq__mutex_lock(m)		pthread_mutex_lock(m)
+  #define libmpq__mutex_unlock(m)	pthread_mutex_unlock(m)
+#endif
+
+/* monotonic clock in nanoseconds, used for the codec statistics. */
+#ifdef _WIN32
+  static __inline uint64_t libmpq__clock(void) {
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000 +
+	       (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+  }
+#else
+  #include <time.h>
+  static inline uint64_t libmpq__clock(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  }
 #endif
 
 #endif								/* _PLATFORM_H */
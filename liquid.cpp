@@ -100,8 +100,8 @@ void Liquid::initGeometry(MPQFile &f)
 {
 	// assume: f is at the appropriate starting position
 
-	LiquidVertex *map = (LiquidVertex*) f.getPointer();
-	unsigned char *flags = (unsigned char*) (f.getPointer() + (xtiles+1)*(ytiles+1)*sizeof(LiquidVertex));
+	LiquidVertex *map = (LiquidVertex*) f.getConstPointer();
+	unsigned char *flags = (unsigned char*) (f.getConstPointer() + (xtiles+1)*(ytiles+1)*sizeof(LiquidVertex));
 
 	// generate vertices
 	Vec3D *verts = new Vec3D[(xtiles+1)*(ytiles+1)];
@@ -235,6 +235,9 @@ void Liquid::draw()
 	glDisable(GL_CULL_FACE);
 	glDepthFunc(GL_LESS);
 	size_t texidx = (size_t)(gWorld->animtime / 60.0f) % textures.size();
+	// the animation cycles through all of them, so they stay resident together
+	for (size_t i=0; i<textures.size(); i++)
+		video.textures.touch(textures[i], 0);
 	glBindTexture(GL_TEXTURE_2D, textures[texidx]);
 
 	const float tcol = trans ? 0.9f : 1.0f;
@@ -0,0 +1,2 @@
+#include "blp.h"
+int main(){ return benchmarkBLP(3) ? 0 : 1; }
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <map>
+#include <list>
 
 // base class for manager objects
 
@@ -22,6 +23,9 @@ public:
 	{
 		return --refcount==0;
 	}
+
+	// rough memory held by the item, weighs it in the zombie pool
+	virtual size_t memoryBytes() const { return 0; }
 	
 };
 
@@ -29,11 +33,41 @@ public:
 
 template <class IDTYPE>
 class Manager {
+	// released items wait here, least recently released first, until the pool is over its
+	// budget or add() asks for them again
+	struct Zombie {
+		IDTYPE id;
+		ManagedItem *item;
+		size_t bytes;
+	};
+	std::list<Zombie> zombies;
+	std::map<std::string, typename std::list<Zombie>::iterator> zombieNames;
+	size_t zombieBudget, zombieBytes;
+
+	void destroy(IDTYPE id, ManagedItem *i)
+	{
+		doDelete(id, i);
+		delete i;
+	}
+
+	void trimZombies()
+	{
+		while (zombieBytes > zombieBudget && !zombies.empty()) {
+			Zombie z = zombies.front();
+			zombies.pop_front();
+			zombieNames.erase(z.item->name);
+			zombieBytes -= z.bytes;
+			evictions++;
+			destroy(z.id, z.item);
+		}
+	}
+
 public:
 	std::map<std::string, IDTYPE> names;
 	std::map<IDTYPE, ManagedItem*> items;
+	unsigned int loads, revivals, evictions;
 
-	Manager()
+	Manager() : zombieBudget(0), zombieBytes(0), loads(0), revivals(0), evictions(0)
 	{
 	}
 
@@ -43,19 +77,49 @@ public:
 	{
 		if (items[id]->delref()) {
 			ManagedItem *i = items[id];
-			doDelete(id);
 			names.erase(names.find(i->name));
 			items.erase(items.find(id));
-			delete i;
+			if (!zombieBudget || !doRelease(id, i)) {
+				destroy(id, i);
+				return;
+			}
+
+			// small or not yet loaded items still count, so the pool cannot grow without bound
+			Zombie z = { id, i, i->memoryBytes() < 1024 ? 1024 : i->memoryBytes() };
+			zombieNames[i->name] = zombies.insert(zombies.end(), z);
+			zombieBytes += z.bytes;
+			trimZombies();
 		}
 	}
 
+	// 0 frees items as soon as they are released
+	void setZombieBudget(size_t bytes)
+	{
+		zombieBudget = bytes;
+		trimZombies();
+	}
+
+	size_t getZombieBytes() { return zombieBytes; }
+	size_t zombieCount() { return zombies.size(); }
+
+	// frees every item in the pool
+	void purgeZombies()
+	{
+		size_t budget = zombieBudget;
+		zombieBudget = 0;
+		trimZombies();
+		zombieBudget = budget;
+	}
+
 	void delbyname(std::string name)
 	{
 		if (has(name)) del(get(name));
 	}
 
-	virtual void doDelete(IDTYPE id) {}
+	virtual void doDelete(IDTYPE id, ManagedItem *item) {}
+	// an item about to enter the pool can shrink itself first, it is weighed afterwards;
+	// false destroys it instead
+	virtual bool doRelease(IDTYPE id, ManagedItem *item) { return true; }
 
 	bool has(std::string name)
 	{
@@ -73,6 +137,27 @@ protected:
 		names[name] = id;
 		item->addref();
 		items[id] = item;
+		loads++;
+	}
+
+	// brings a released item back from the pool, as it was when it went in
+	bool revive(const std::string &name, IDTYPE &id)
+	{
+		typename std::map<std::string, typename std::list<Zombie>::iterator>::iterator it = zombieNames.find(name);
+		if (it == zombieNames.end())
+			return false;
+
+		Zombie z = *it->second;
+		zombies.erase(it->second);
+		zombieNames.erase(it);
+		zombieBytes -= z.bytes;
+
+		id = z.id;
+		names[name] = id;
+		z.item->addref();
+		items[id] = z.item;
+		revivals++;
+		return true;
 	}
 };
 
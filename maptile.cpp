@@ -282,6 +282,10 @@ struct MapChunkHeader {
 void MapChunk::init(MapTile* mt, MPQFile &f)
 {
 	Vec3D tn[mapbufsize], tv[mapbufsize];
+	// strips 0-2 are the alpha maps of layers 1-3, strip 3 the shadow map; each map starts one
+	// row into its strip, the last row spills into the next strip and is replaced below
+	unsigned char blendbuf[64*64*blendStrips + 64];
+	memset(blendbuf, 0, sizeof(blendbuf));
 
     f.seekRelative(4);
 	char fcc[5];
@@ -421,8 +425,8 @@ void MapChunk::init(MapTile* mt, MPQFile &f)
 		}
 		else if (!strcmp(fcc,"MCSH")) {
 			// shadow map 64 x 64
-			unsigned char sbuf[64*64], *p, c[8];
-			p = sbuf;
+			unsigned char *p, c[8];
+			p = blendbuf + 64*64*3 + 64;
 			for (int j=0; j<64; j++) {
 				f.read(c,8);
 				for (int i=0; i<8; i++) {
@@ -431,24 +435,14 @@ void MapChunk::init(MapTile* mt, MPQFile &f)
 					}
 				}
 			}
-			glGenTextures(1, &shadow);
-			glBindTexture(GL_TEXTURE_2D, shadow);
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 64, 0, GL_ALPHA, GL_UNSIGNED_BYTE, sbuf);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
 		}
 		else if (!strcmp(fcc,"MCAL")) {
 			// alpha maps  64 x 64
 			if (nTextures>0) {
-				glGenTextures(nTextures-1, alphamaps);
 				for (int i=0; i<nTextures-1; i++) {
-					glBindTexture(GL_TEXTURE_2D, alphamaps[i]);
-					unsigned char amap[64*64], *p;
-					char *abuf = f.getPointer();
-					p = amap;
+					unsigned char *p;
+					const char *abuf = f.getConstPointer();
+					p = blendbuf + 64*64*i + 64;
 					for (int j=0; j<64; j++) {
 						for (int i=0; i<32; i++) {
 							unsigned char c = *abuf++;
@@ -457,11 +451,6 @@ void MapChunk::init(MapTile* mt, MPQFile &f)
 						}
 
 					}
-					glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 64, 0, GL_ALPHA, GL_UNSIGNED_BYTE, amap);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-					glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 					f.seekRelative(0x800);
 				}
 			} else {
@@ -509,6 +498,20 @@ void MapChunk::init(MapTile* mt, MPQFile &f)
 		f.seek((int)nextpos);
 	}
 
+	// the first row of each strip repeats the first map row, as clamping did for a 64x64 texture;
+	// the alpha texture coordinates stop at 0.95, so the map rows that did not fit are never sampled
+	for (int i=0; i<blendStrips; i++)
+		memcpy(blendbuf + 64*64*i, blendbuf + 64*64*i + 64, 64);
+
+	// one texture for all alpha and shadow maps of the chunk
+	glGenTextures(1, &blendmap);
+	glBindTexture(GL_TEXTURE_2D, blendmap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 64*blendStrips, 0, GL_ALPHA, GL_UNSIGNED_BYTE, blendbuf);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
 	// create vertex buffers
 	glGenBuffersARB(1,&vertices);
 	glGenBuffersARB(1,&normals);
@@ -565,10 +568,8 @@ void MapChunk::initStrip(int holes)
 
 void MapChunk::destroy()
 {
-	// unload alpha maps
-	glDeleteTextures(nTextures-1, alphamaps);
-	// shadow maps, too
-	glDeleteTextures(1, &shadow);
+	// unload alpha and shadow maps
+	glDeleteTextures(1, &blendmap);
 
 	// delete VBOs
 	glDeleteBuffersARB(1, &vertices);
@@ -579,6 +580,17 @@ void MapChunk::destroy()
 	if (haswater) delete lq;
 }
 
+void MapChunk::selectStrip(int strip)
+{
+	// maps the alpha texture coordinates on unit 1 into one strip of the blend map, past its
+	// repeated first row, so every texel is sampled where the 64x64 texture had it
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glTranslatef(0, strip * stripScale + stripOffset, 0);
+	glScalef(1.0f, stripScale, 1.0f);
+	glMatrixMode(GL_MODELVIEW);
+}
+
 void MapChunk::drawPass(int anim)
 {
 	if (anim) {
@@ -599,6 +611,7 @@ void MapChunk::drawPass(int anim)
 	}
 
 	glDrawElements(GL_TRIANGLE_STRIP, striplen, GL_UNSIGNED_SHORT, strip);
+	gWorld->terrainDrawCalls++;
 
 	if (anim) {
         glPopMatrix();
@@ -621,6 +634,9 @@ void MapChunk::draw()
 
 	if (nTextures==0) return;
 
+	for (int i=0; i<nTextures; i++)
+		video.textures.touch(textures[i], mydist);
+
 	if (!hasholes) {
 		bool highres = gWorld->drawhighres;
 		if (highres) {
@@ -635,6 +651,20 @@ void MapChunk::draw()
 		}
 	}
 
+	gWorld->terrainChunks++;
+
+	// the fragment programs read every layer with the same coordinates, so chunks with
+	// animated layers keep the multipass path
+	if (gWorld->shaderterrain) {
+		bool anim = false;
+		for (int i=0; i<nTextures; i++)
+			if (animated[i]) anim = true;
+		if (!anim) {
+			gWorld->shaderchunks.push_back(this);
+			return;
+		}
+	}
+
 	// setup vertex buffers
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices);
 	glVertexPointer(3, GL_FLOAT, 0, 0);
@@ -646,6 +676,7 @@ void MapChunk::draw()
 	glActiveTextureARB(GL_TEXTURE0_ARB);
 	glEnable(GL_TEXTURE_2D);
 	glBindTexture(GL_TEXTURE_2D, textures[0]);
+	gWorld->terrainBinds++;
 
 	glActiveTextureARB(GL_TEXTURE1_ARB);
 	glDisable(GL_TEXTURE_2D);
@@ -657,15 +688,20 @@ void MapChunk::draw()
 		glDepthMask(GL_FALSE);
 	}
 
+	// unit 1 keeps the blend map for the remaining passes
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, blendmap);
+	gWorld->terrainBinds++;
+
 	// additional passes: if required
 	for (int i=0; i<nTextures-1; i++) {
 		glActiveTextureARB(GL_TEXTURE0_ARB);
 		glEnable(GL_TEXTURE_2D);
 		glBindTexture(GL_TEXTURE_2D, textures[i+1]);
+		gWorld->terrainBinds++;
 		// this time, use blending:
 		glActiveTextureARB(GL_TEXTURE1_ARB);
-		glEnable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, alphamaps[i]);
+		selectStrip(i);
 
 		drawPass(animated[i+1]);
 
@@ -686,11 +722,14 @@ void MapChunk::draw()
 	glColor4f(shc.x,shc.y,shc.z,1);
 
 	glActiveTextureARB(GL_TEXTURE1_ARB);
-	glBindTexture(GL_TEXTURE_2D, shadow);
-	glEnable(GL_TEXTURE_2D);
+	selectStrip(3);
 
 	drawPass(0);
 
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+
 	glEnable(GL_LIGHTING);
 	glColor4f(1,1,1,1);
 
@@ -727,6 +766,18 @@ void MapChunk::draw()
 	*/
 }
 
+void MapChunk::drawSinglePass()
+{
+	// textures and program are set up by World::drawShaderChunks
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertices);
+	glVertexPointer(3, GL_FLOAT, 0, 0);
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, normals);
+	glNormalPointer(GL_FLOAT, 0, 0);
+
+	glDrawElements(GL_TRIANGLE_STRIP, striplen, GL_UNSIGNED_SHORT, strip);
+	gWorld->terrainDrawCalls++;
+}
+
 void MapChunk::drawNoDetail()
 {
 	glActiveTextureARB(GL_TEXTURE1_ARB);
@@ -20,6 +20,12 @@ class MapChunk;
 class World;
 
 const int mapbufsize = 9*9 + 8*8;
+// 64x64 alpha maps per chunk blend map: three layers and the shadow
+const int blendStrips = 4;
+// alpha coordinate t samples strip k at t * stripScale + stripOffset + k * stripScale,
+// one row into the strip (see MapChunk::selectStrip)
+const float stripScale = 1.0f / blendStrips;
+const float stripOffset = 1.0f / (64 * blendStrips);
 
 class MapNode {
 public:
@@ -54,8 +60,9 @@ public:
 	float waterlevel;
 
 	TextureID textures[4];
-	TextureID alphamaps[3];
-	TextureID shadow;
+	// the three layer alpha maps and the shadow map, stacked as 64x64 strips of one texture,
+	// each map shifted down a row below a copy of its first one (see selectStrip)
+	TextureID blendmap;
 
 	int animated[4];
 
@@ -74,7 +81,9 @@ public:
 
 	void draw();
 	void drawNoDetail();
+	void drawSinglePass();
 	void drawPass(int anim);
+	void selectStrip(int strip);
 	void drawWater();
 
 };
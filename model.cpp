@@ -29,7 +29,7 @@ Model::Model(std::string name, bool forceAnim) : ManagedItem(name), forceAnim(fo
 		return;
 	}
 
-	memcpy(&header, f.getBuffer(), sizeof(ModelHeader));
+	memcpy(&header, f.getConstBuffer(), sizeof(ModelHeader));
 
 	// HACK: these particle systems are way too active and cause horrible horrible slowdowns
 	// I'm removing them until I can fix emission speed so it doesn't get this crazy
@@ -58,7 +58,7 @@ Model::Model(std::string name, bool forceAnim) : ManagedItem(name), forceAnim(fo
 	ribbons = 0;
 	if (header.nGlobalSequences) {
 		globalSequences = new int[header.nGlobalSequences];
-		memcpy(globalSequences, (f.getBuffer() + header.ofsGlobalSequences), header.nGlobalSequences * 4);
+		memcpy(globalSequences, (f.getConstBuffer() + header.ofsGlobalSequences), header.nGlobalSequences * 4);
 	}
 
 	if (animated) initAnimated(f);
@@ -119,15 +119,15 @@ bool Model::isAnimated(MPQFile &f)
     ModelBoneDefTBC *boTbc;
     ModelBoneDef *bo;
     if (expansion > 0)
-        boTbc = (ModelBoneDefTBC*)(f.getBuffer() + header.ofsBones);
+        boTbc = (ModelBoneDefTBC*)(f.getConstBuffer() + header.ofsBones);
     else
-        bo = (ModelBoneDef*)(f.getBuffer() + header.ofsBones);
+        bo = (ModelBoneDef*)(f.getConstBuffer() + header.ofsBones);
 
 	animGeometry = false;
 	animBones = false;
 	ind = false;
 
-	ModelVertex *verts = (ModelVertex*)(f.getBuffer() + header.ofsVertices);
+	ModelVertex *verts = (ModelVertex*)(f.getConstBuffer() + header.ofsVertices);
 	for (size_t i=0; i<header.nVertices && !animGeometry; i++) {
 		for (size_t b=0; b<4; b++) {
 			if (verts[i].weights[b]>0) {
@@ -192,7 +192,7 @@ bool Model::isAnimated(MPQFile &f)
 
 	// animated colors
 	if (header.nColors) {
-		ModelColorDef *cols = (ModelColorDef*)(f.getBuffer() + header.ofsColors);
+		ModelColorDef *cols = (ModelColorDef*)(f.getConstBuffer() + header.ofsColors);
 		for (size_t i=0; i<header.nColors; i++) {
 			if (cols[i].color.type!=0 || cols[i].opacity.type!=0) {
 				animMisc = true;
@@ -203,7 +203,7 @@ bool Model::isAnimated(MPQFile &f)
 
 	// animated opacity
 	if (header.nTransparency && !animMisc) {
-		ModelTransDef *trs = (ModelTransDef*)(f.getBuffer() + header.ofsTransparency);
+		ModelTransDef *trs = (ModelTransDef*)(f.getConstBuffer() + header.ofsTransparency);
 		for (size_t i=0; i<header.nTransparency; i++) {
 			if (trs[i].trans.type!=0) {
 				animMisc = true;
@@ -270,12 +270,12 @@ void Model::initCommon(MPQFile &f)
 	//rad = std::max(vmin.length(),vmax.length());
 
 	// textures
-	ModelTextureDef* texdef = (ModelTextureDef*)(f.getBuffer() + header.ofsTextures);
+	ModelTextureDef* texdef = (ModelTextureDef*)(f.getConstBuffer() + header.ofsTextures);
 	if (header.nTextures) {
 		textures = new TextureID[header.nTextures];
 		for (size_t i = 0; i < header.nTextures; i++) {
 			char texname[256];
-			strncpy(texname, f.getBuffer() + texdef[i].nameOfs, texdef[i].nameLen);
+			strncpy(texname, f.getConstBuffer() + texdef[i].nameOfs, texdef[i].nameLen);
 			texname[texdef[i].nameLen] = 0;
 			std::string path(texname);
 			fixname(path);
@@ -291,24 +291,24 @@ void Model::initCommon(MPQFile &f)
 	// init colors
 	if (header.nColors) {
 		colors = new ModelColor[header.nColors];
-		ModelColorDef *colorDefs = (ModelColorDef*)(f.getBuffer() + header.ofsColors);
+		ModelColorDef *colorDefs = (ModelColorDef*)(f.getConstBuffer() + header.ofsColors);
 		for (size_t i=0; i<header.nColors; i++) colors[i].init(f, colorDefs[i], globalSequences);
 	}
 	// init transparency
-	int16 *transLookup = (int16*)(f.getBuffer() + header.ofsTransparencyLookup);
+	int16 *transLookup = (int16*)(f.getConstBuffer() + header.ofsTransparencyLookup);
 	if (header.nTransparency) {
 		transparency = new ModelTransparency[header.nTransparency];
-		ModelTransDef *trDefs = (ModelTransDef*)(f.getBuffer() + header.ofsTransparency);
+		ModelTransDef *trDefs = (ModelTransDef*)(f.getConstBuffer() + header.ofsTransparency);
 		for (size_t i=0; i<header.nTransparency; i++) transparency[i].init(f, trDefs[i], globalSequences);
 	}
 
 	// just use the first LOD/view
 
 	// indices - allocate space, too
-	ModelView *view = (ModelView*)(f.getBuffer() + header.ofsViews);
+	ModelView *view = (ModelView*)(f.getConstBuffer() + header.ofsViews);
 
-	uint16 *indexLookup = (uint16*)(f.getBuffer() + view->ofsIndex);
-	uint16 *triangles = (uint16*)(f.getBuffer() + view->ofsTris);
+	uint16 *indexLookup = (uint16*)(f.getConstBuffer() + view->ofsIndex);
+	uint16 *triangles = (uint16*)(f.getConstBuffer() + view->ofsTris);
 	nIndices = view->nTris;
 	indices = new uint16[nIndices];
 	for (size_t i = 0; i<nIndices; i++) {
@@ -319,15 +319,15 @@ void Model::initCommon(MPQFile &f)
     ModelGeosetTBC *opsTbc;
     ModelGeoset *ops;
     if (expansion > 0)
-        opsTbc = (ModelGeosetTBC*)(f.getBuffer() + view->ofsSub);
+        opsTbc = (ModelGeosetTBC*)(f.getConstBuffer() + view->ofsSub);
     else
-        ops = (ModelGeoset*)(f.getBuffer() + view->ofsSub);
-    //ModelGeoset *ops = (ModelGeoset*)(f.getBuffer() + view->ofsSub);
-	ModelTexUnit *tex = (ModelTexUnit*)(f.getBuffer() + view->ofsTex);
-	ModelRenderFlags *renderFlags = (ModelRenderFlags*)(f.getBuffer() + header.ofsTexFlags);
-	uint16 *texlookup = (uint16*)(f.getBuffer() + header.ofsTexLookup);
-	uint16 *texanimlookup = (uint16*)(f.getBuffer() + header.ofsTexAnimLookup);
-	int16 *texunitlookup = (int16*)(f.getBuffer() + header.ofsTexUnitLookup);
+        ops = (ModelGeoset*)(f.getConstBuffer() + view->ofsSub);
+    //ModelGeoset *ops = (ModelGeoset*)(f.getConstBuffer() + view->ofsSub);
+	ModelTexUnit *tex = (ModelTexUnit*)(f.getConstBuffer() + view->ofsTex);
+	ModelRenderFlags *renderFlags = (ModelRenderFlags*)(f.getConstBuffer() + header.ofsTexFlags);
+	uint16 *texlookup = (uint16*)(f.getConstBuffer() + header.ofsTexLookup);
+	uint16 *texanimlookup = (uint16*)(f.getConstBuffer() + header.ofsTexAnimLookup);
+	int16 *texunitlookup = (int16*)(f.getConstBuffer() + header.ofsTexUnitLookup);
 
 	/*
 	for (size_t i = 0; i<view->nSub; i++) {
@@ -477,7 +477,7 @@ void Model::initStatic(MPQFile &f)
 void Model::initAnimated(MPQFile &f)
 {
 	origVertices = new ModelVertex[header.nVertices];
-	memcpy(origVertices, f.getBuffer() + header.ofsVertices, header.nVertices * sizeof(ModelVertex));
+	memcpy(origVertices, f.getConstBuffer() + header.ofsVertices, header.nVertices * sizeof(ModelVertex));
 
 	glGenBuffersARB(1,&vbuf);
 	glGenBuffersARB(1,&tbuf);
@@ -493,13 +493,13 @@ void Model::initAnimated(MPQFile &f)
         ModelBoneDef *mb;
         if (expansion > 0) {
 
-            mbTbc = (ModelBoneDefTBC *) (f.getBuffer() + header.ofsBones);
+            mbTbc = (ModelBoneDefTBC *) (f.getConstBuffer() + header.ofsBones);
             for (size_t i=0; i<header.nBones; i++) {
                 bones[i].init(f, mbTbc[i], globalSequences);
             }
         }
         else {
-            mb = (ModelBoneDef *) (f.getBuffer() + header.ofsBones);
+            mb = (ModelBoneDef *) (f.getConstBuffer() + header.ofsBones);
             for (size_t i=0; i<header.nBones; i++) {
                 bones[i].init(f, mb[i], globalSequences);
             }
@@ -524,7 +524,7 @@ void Model::initAnimated(MPQFile &f)
 
 	if (animTextures) {
 		texanims = new TextureAnim[header.nTexAnims];
-		ModelTexAnimDef *ta = (ModelTexAnimDef*)(f.getBuffer() + header.ofsTexAnims);
+		ModelTexAnimDef *ta = (ModelTexAnimDef*)(f.getConstBuffer() + header.ofsTexAnims);
 		for (size_t i=0; i<header.nTexAnims; i++) {
 			texanims[i].init(f, ta[i], globalSequences);
 		}
@@ -532,7 +532,7 @@ void Model::initAnimated(MPQFile &f)
 
 	// particle systems
 	if (header.nParticleEmitters) {
-		ModelParticleEmitterDef *pdefs = (ModelParticleEmitterDef *)(f.getBuffer() + header.ofsParticleEmitters);
+		ModelParticleEmitterDef *pdefs = (ModelParticleEmitterDef *)(f.getConstBuffer() + header.ofsParticleEmitters);
 		particleSystems = new ParticleSystem[header.nParticleEmitters];
 		for (size_t i=0; i<header.nParticleEmitters; i++) {
 			particleSystems[i].model = this;
@@ -542,7 +542,7 @@ void Model::initAnimated(MPQFile &f)
 
 	// ribbons
 	if (header.nRibbonEmitters) {
-		ModelRibbonEmitterDef *rdefs = (ModelRibbonEmitterDef *)(f.getBuffer() + header.ofsRibbonEmitters);
+		ModelRibbonEmitterDef *rdefs = (ModelRibbonEmitterDef *)(f.getConstBuffer() + header.ofsRibbonEmitters);
 		ribbons = new RibbonEmitter[header.nRibbonEmitters];
 		for (size_t i=0; i<header.nRibbonEmitters; i++) {
 			ribbons[i].model = this;
@@ -552,19 +552,19 @@ void Model::initAnimated(MPQFile &f)
 
 	// just use the first camera, meh
 	if (header.nCameras>0) {
-		ModelCameraDef *camDefs = (ModelCameraDef*)(f.getBuffer() + header.ofsCameras);
+		ModelCameraDef *camDefs = (ModelCameraDef*)(f.getConstBuffer() + header.ofsCameras);
 		cam.init(f, camDefs[0], globalSequences);
 	}
 
 	// init lights
 	if (header.nLights) {
 		lights = new ModelLight[header.nLights];
-		ModelLightDef *lDefs = (ModelLightDef*)(f.getBuffer() + header.ofsLights);
+		ModelLightDef *lDefs = (ModelLightDef*)(f.getConstBuffer() + header.ofsLights);
 		for (size_t i=0; i<header.nLights; i++) lights[i].init(f, lDefs[i], globalSequences);
 	}
 
 	anims = new ModelAnimation[header.nAnimations];
-	memcpy(anims, f.getBuffer() + header.ofsAnimations, header.nAnimations * sizeof(ModelAnimation));
+	memcpy(anims, f.getConstBuffer() + header.ofsAnimations, header.nAnimations * sizeof(ModelAnimation));
 
 	animcalc = false;
 }
@@ -1143,6 +1143,8 @@ int ModelManager::add(std::string name)
 		items[id]->addref();
 		return id;
 	}
+	if (revive(name, id))
+		return id;
 	// load new
 	Model *model = new Model(name);
 	id = nextID();
@@ -1196,6 +1198,19 @@ void ModelInstance::init2(Model *m, MPQFile &f)
 
 
 
+void Model::touchTextures(float distance)
+{
+	if (!HasTextures()) return;
+	for (size_t i=0; i<header.nTextures; i++)
+		video.textures.touch(textures[i], distance);
+}
+
+size_t Model::memoryBytes() const
+{
+	// geometry only, the textures are weighed by their own manager
+	return header.nVertices * (sizeof(ModelVertex) + 2 * sizeof(Vec3D)) + nIndices * sizeof(uint16);
+}
+
 void ModelInstance::draw()
 {
 	//if ((pos - gWorld->camera).lengthSquared() > (gWorld->modeldrawdistance2+(model->rad*model->rad*sc))) return;
@@ -1212,6 +1227,7 @@ void ModelInstance::draw()
 
 	glScalef(sc,sc,sc);
 
+	model->touchTextures(dist);
 	model->draw();
 	glPopMatrix();
 }
@@ -1238,6 +1254,7 @@ void ModelInstance::draw2(const Vec3D& ofs, const float rot)
 	glQuaternionRotate(vdir,w);
 	glScalef(sc,-sc,-sc);
 
+	model->touchTextures((tpos - gWorld->camera).length() - model->rad*sc);
 	model->draw();
 	glPopMatrix();
 }
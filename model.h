@@ -184,6 +184,8 @@ public:
 	~Model();
 	void draw();
 	void updateEmitters(float dt);
+	void touchTextures(float distance);
+	size_t memoryBytes() const;
 
 	friend struct ModelRenderPass;
 };
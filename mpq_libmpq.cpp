@@ -17,14 +17,26 @@
 */
 
 #include "mpq_libmpq.h"
+#include "threadpool.h"
+#include "mpqpack.h"
+#include "mpqloose.h"
 #include <deque>
 #include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
 
 ArchiveSet gOpenArchives;
 
-MPQArchive::MPQArchive(const char* filename)
+uint32 MPQArchive::openFlags = 0;
+
+MPQArchive::MPQArchive(const char* filename) :
+    filename(filename)
 {
-    int result = libmpq__archive_open(&mpq_a, filename, -1);
+    int result = libmpq__archive_open_flags(&mpq_a, filename, -1, openFlags);
     printf("Opening %s\n", filename);
     if (result)
     {
@@ -51,6 +63,15 @@ MPQArchive::MPQArchive(const char* filename)
         }
         return;
     }
+
+    if (openFlags & LIBMPQ_OPEN_MMAP)
+    {
+        uint32 mapped;
+        libmpq__archive_mapped(mpq_a, &mapped);
+        if (!mapped)
+            printf("Could not map archive '%s', using buffered reads\n", filename);
+    }
+
     gOpenArchives.push_front(this);
 }
 
@@ -60,39 +81,1032 @@ void MPQArchive::close()
     libmpq__archive_close(mpq_a);
 }
 
-MPQFile::MPQFile(const char* filename) :
-    eof(false),
-    buffer(0),
-    pointer(0),
-    size(0)
+std::unordered_map<uint64, MPQIndex::Entry> MPQIndex::entries;
+bool MPQIndex::built = false;
+
+uint64 MPQIndex::key(const char* filename)
+{
+    // the hashes ignore case but not the separator, so only slashes need normalizing
+    char name[512];
+    size_t i = 0;
+    for (; filename[i] && i < sizeof(name) - 1; ++i)
+        name[i] = filename[i] == '/' ? '\\' : filename[i];
+    name[i] = 0;
+
+    uint32 hash_a, hash_b;
+    libmpq__hash_name(name, &hash_a, &hash_b);
+    return (uint64(hash_a) << 32) | hash_b;
+}
+
+void MPQIndex::build()
+{
+    entries.clear();
+
+    uint32 total = 0;
+    for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
+    {
+        mpq_archive_s* mpq_a = (*i)->mpq_a;
+
+        uint32 hashes;
+        libmpq__archive_hashes(mpq_a, &hashes);
+        total += hashes;
+        entries.reserve(entries.size() + hashes);
+
+        for (uint32 h = 0; h < hashes; ++h)
+        {
+            Entry e;
+            uint32 hash_a, hash_b;
+            if (libmpq__hash_entry(mpq_a, h, &hash_a, &hash_b, &e.locale, &e.filenum))
+                continue;
+            e.archive = mpq_a;
+
+            auto res = entries.emplace((uint64(hash_a) << 32) | hash_b, e);
+            // an earlier archive keeps the file, within one archive prefer the neutral locale
+            if (!res.second && res.first->second.archive == mpq_a && res.first->second.locale != 0 && e.locale == 0)
+                res.first->second = e;
+        }
+    }
+
+    built = true;
+    printf("Indexed %u files from %u archives (%u hash entries)\n", (uint32)entries.size(), (uint32)gOpenArchives.size(), total);
+}
+
+void MPQIndex::clear()
+{
+    entries.clear();
+    built = false;
+}
+
+bool MPQIndex::find(const char* filename, mpq_archive_s*& archive, uint32& filenum)
+{
+    std::unordered_map<uint64, Entry>::const_iterator it = entries.find(key(filename));
+    if (it == entries.end())
+        return false;
+
+    archive = it->second.archive;
+    filenum = it->second.filenum;
+    return true;
+}
+
+std::atomic<uint64> MPQCache::budget(0);
+MPQCache::NodeList MPQCache::lru;
+std::unordered_map<MPQCache::Key, MPQCache::NodeList::iterator, MPQCache::KeyHash> MPQCache::nodes;
+MPQCache::Stats MPQCache::stats = {0, 0, 0, 0, 0, 0};
+std::mutex MPQCache::lock;
+
+void MPQCache::setBudget(uint64 bytes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    budget = bytes;
+    evict(budget);
+}
+
+MPQView MPQCache::fetch(mpq_archive_s* archive, uint32 filenum, libmpq__off_t size, bool streaming)
+{
+    MPQView view;
+    if (!budget)
+        return view;
+
+    std::lock_guard<std::mutex> guard(lock);
+    Key key = {archive, filenum};
+    auto it = nodes.find(key);
+    if (it == nodes.end() || (libmpq__off_t)it->second->data->size() != size)
+    {
+        ++(streaming ? stats.bypasses : stats.misses);
+        return view;
+    }
+
+    ++stats.hits;
+    lru.splice(lru.begin(), lru, it->second);
+
+    view.data = &(*it->second->data)[0];
+    view.size = (size_t)size;
+    view.owner = it->second->data;
+    return view;
+}
+
+void MPQCache::store(mpq_archive_s* archive, uint32 filenum, const std::shared_ptr<std::vector<char>>& data)
+{
+    uint64 size = data->size();
+
+    std::lock_guard<std::mutex> guard(lock);
+    // a file bigger than the whole budget would only flush everything else
+    uint64 limit = budget;
+    if (size > limit)
+        return;
+
+    Key key = {archive, filenum};
+    if (nodes.find(key) != nodes.end())
+        return;
+
+    evict(limit - size);
+
+    lru.push_front(Node());
+    lru.front().key = key;
+    lru.front().data = data;
+    nodes[key] = lru.begin();
+
+    stats.bytes += size;
+    ++stats.files;
+}
+
+void MPQCache::store(mpq_archive_s* archive, uint32 filenum, const char* data, libmpq__off_t size)
+{
+    if ((uint64)size > budget)
+        return;
+
+    store(archive, filenum, std::make_shared<std::vector<char>>(data, data + size));
+}
+
+void MPQCache::evict(uint64 limit)
+{
+    while (stats.bytes > limit && !lru.empty())
+    {
+        Node& node = lru.back();
+        stats.bytes -= node.data->size();
+        --stats.files;
+        ++stats.evictions;
+        nodes.erase(node.key);
+        lru.pop_back();
+    }
+}
+
+void MPQCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    nodes.clear();
+    lru.clear();
+    stats.bytes = 0;
+    stats.files = 0;
+}
+
+MPQCache::Stats MPQCache::getStats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+vector<string> MPQDirectory::names;
+std::unordered_map<string, vector<uint32>> MPQDirectory::byExtension;
+bool MPQDirectory::built = false;
+std::mutex MPQDirectory::lock;
+
+string MPQDirectory::normalize(const char* name, size_t length)
+{
+    string result(name, length);
+    for (size_t i = 0; i < length; ++i)
+        result[i] = result[i] == '/' ? '\\' : (char)toupper((unsigned char)result[i]);
+    return result;
+}
+
+void MPQDirectory::build()
 {
+    std::lock_guard<std::mutex> guard(lock);
+    buildLocked();
+}
+
+void MPQDirectory::buildLocked()
+{
+    names.clear();
+    byExtension.clear();
+
+    // every archive has its own listfile, so they are read directly instead of through the index
     for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
     {
-        mpq_archive* mpq_a = (*i)->mpq_a;
+        mpq_archive_s* mpq_a = (*i)->mpq_a;
 
         uint32 filenum;
-        if (libmpq__file_number(mpq_a, filename, &filenum)) continue;
-        libmpq__off_t transferred;
-        libmpq__file_unpacked_size(mpq_a, filenum, &size);
+        libmpq__off_t size, transferred;
+        if (libmpq__file_number(mpq_a, "(listfile)", &filenum) || libmpq__file_unpacked_size(mpq_a, filenum, &size) || size <= 0)
+            continue;
+
+        vector<char> list((size_t)size);
+        if (libmpq__file_read(mpq_a, filenum, (unsigned char*)&list[0], size, &transferred))
+            continue;
 
-        // HACK: in patch.mpq some files don't want to open and give 1 for filesize
-        if (size <= 1)
+        // entries are separated by newlines, semicolons or both
+        const char* p = &list[0];
+        const char* end = p + size;
+        while (p < end)
         {
-            // printf("info: file %s has size %d; considered dummy file.\n", filename, size);
-            eof = true;
-            buffer = 0;
-            return;
+            const char* e = p;
+            while (e < end && *e != '\r' && *e != '\n' && *e != ';')
+                ++e;
+            if (e > p)
+                names.push_back(normalize(p, e - p));
+            p = e + 1;
         }
-        buffer = new char[size];
+    }
 
-        //libmpq_file_getdata
-        libmpq__file_read(mpq_a, filenum, (unsigned char*)buffer, size, &transferred);
-        /*libmpq_file_getdata(&mpq_a, hash, fileno, (unsigned char*)buffer);*/
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    // listfiles also name files that were deleted or only exist in another locale
+    if (MPQIndex::isBuilt())
+    {
+        mpq_archive_s* mpq_a;
+        uint32 filenum;
+        names.erase(std::remove_if(names.begin(), names.end(),
+            [&](const string& name) { return !MPQIndex::find(name.c_str(), mpq_a, filenum); }), names.end());
+    }
+
+    for (uint32 i = 0; i < names.size(); ++i)
+    {
+        size_t dot = names[i].find_last_of(".\\");
+        if (dot != string::npos && names[i][dot] == '.')
+            byExtension[names[i].substr(dot + 1)].push_back(i);
+    }
+
+    built = true;
+    printf("Listed %u files from %u archives\n", (uint32)names.size(), (uint32)gOpenArchives.size());
+}
+
+void MPQDirectory::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    names.clear();
+    byExtension.clear();
+    built = false;
+}
+
+size_t MPQDirectory::size()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!built)
+        buildLocked();
+    return names.size();
+}
+
+void MPQDirectory::find(const char* prefix, const char* extension, vector<string>& result)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!built)
+        buildLocked();
+
+    string key = normalize(prefix, strlen(prefix));
+
+    if (!extension || !*extension)
+    {
+        for (vector<string>::const_iterator it = std::lower_bound(names.begin(), names.end(), key);
+            it != names.end() && it->compare(0, key.size(), key) == 0; ++it)
+            result.push_back(*it);
+        return;
+    }
+
+    if (*extension == '.')
+        ++extension;
+    std::unordered_map<string, vector<uint32>>::const_iterator ext = byExtension.find(normalize(extension, strlen(extension)));
+    if (ext == byExtension.end())
+        return;
+
+    // the index list has the order of names, so the prefix range is found the same way
+    const vector<uint32>& list = ext->second;
+    for (vector<uint32>::const_iterator it = std::lower_bound(list.begin(), list.end(), key,
+            [](uint32 i, const string& k) { return names[i] < k; });
+        it != list.end() && names[*it].compare(0, key.size(), key) == 0; ++it)
+        result.push_back(names[*it]);
+}
+
+std::atomic<bool> MPQStats::enabled(false);
+MPQStats::Counters MPQStats::counters[MPQStats::TYPES];
+std::unordered_map<mpq_archive_s*, uint64> MPQStats::archiveHits;
+std::mutex MPQStats::lock;
+
+void MPQStats::enable(bool on)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    memset(counters, 0, sizeof(counters));
+    archiveHits.clear();
+    libmpq__codec_timing(on);
+    enabled = on;
+}
+
+MPQStats::Type MPQStats::typeOf(const char* filename)
+{
+    static const char* const extensions[] = { ".adt", ".blp", ".m2", ".wmo", ".dbc" };
+
+    const char* dot = strrchr(filename, '.');
+    if (!dot || strlen(dot) > 4)
+        return OTHER;
+
+    char ext[8];
+    size_t i = 0;
+    for (; dot[i]; ++i)
+        ext[i] = (char)tolower((unsigned char)dot[i]);
+    ext[i] = 0;
+
+    for (int t = 0; t < OTHER; ++t)
+    {
+        if (!strcmp(ext, extensions[t]))
+            return Type(t);
+    }
+    // models are also named .mdx and .mdl in the listfiles
+    if (!strcmp(ext, ".mdx") || !strcmp(ext, ".mdl"))
+        return M2;
+    return OTHER;
+}
+
+const char* MPQStats::name(Type type)
+{
+    static const char* const names[] = { "adt", "blp", "m2", "wmo", "dbc", "other" };
+    return type < TYPES ? names[type] : "";
+}
+
+MPQStats::Counters MPQStats::get(Type type)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return counters[type];
+}
+
+void MPQStats::opened(Type type, mpq_archive_s* archive, bool found, bool shared, libmpq__off_t readBytes,
+    libmpq__off_t bytes, std::chrono::steady_clock::time_point start)
+{
+    uint64 elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> guard(lock);
+    Counters& c = counters[type];
+    c.opens++;
+    c.nanoseconds += elapsed;
+    if (!found)
+    {
+        c.misses++;
         return;
+    }
+    c.bytes += bytes;
+    if (shared)
+        c.shared++;
+    if (readBytes)
+    {
+        c.readBytes += readBytes;
+        c.inflatedBytes += bytes;
+    }
+    if (archive)
+        archiveHits[archive]++;
+}
 
+void MPQStats::inflated(Type type, libmpq__off_t readBytes, libmpq__off_t bytes,
+    std::chrono::steady_clock::time_point start)
+{
+    uint64 elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::lock_guard<std::mutex> guard(lock);
+    counters[type].readBytes += readBytes;
+    counters[type].inflatedBytes += bytes;
+    counters[type].nanoseconds += elapsed;
+}
+
+void MPQStats::dump()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    printf("MPQ telemetry%s\n", enabled ? "" : " (disabled)");
+    printf("  %-6s %8s %7s %7s %10s %10s %11s %10s\n", "type", "opens", "misses", "shared", "MB", "read MB", "inflated MB", "open ms");
+    for (int t = 0; t < TYPES; ++t)
+    {
+        const Counters& c = counters[t];
+        printf("  %-6s %8llu %7llu %7llu %10.1f %10.1f %11.1f %10.1f\n", name(Type(t)), (unsigned long long)c.opens,
+            (unsigned long long)c.misses, (unsigned long long)c.shared, c.bytes / 1048576.0, c.readBytes / 1048576.0,
+            c.inflatedBytes / 1048576.0, c.nanoseconds * 1e-6);
+    }
+
+    // hits by archive, in patch priority order; pack hits have no archive
+    for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
+    {
+        std::unordered_map<mpq_archive_s*, uint64>::const_iterator hits = archiveHits.find((*i)->mpq_a);
+        if (hits != archiveHits.end())
+            printf("  %8llu hits %s\n", (unsigned long long)hits->second, (*i)->filename.c_str());
+    }
+
+    const char* codec;
+    uint64_t calls, inBytes, outBytes, nanoseconds;
+    for (uint32 c = 0; libmpq__codec_stats(c, &codec, &calls, &inBytes, &outBytes, &nanoseconds) == 0; ++c)
+    {
+        if (calls)
+            printf("  %-12s %8llu calls %10.1f ms %8.1f MB in %8.1f MB out\n", codec, (unsigned long long)calls,
+                nanoseconds * 1e-6, inBytes / 1048576.0, outBytes / 1048576.0);
+    }
+}
+
+void MPQStats::summary(vector<string>& lines)
+{
+    char line[256];
+    std::lock_guard<std::mutex> guard(lock);
+
+    for (int t = 0; t < TYPES; ++t)
+    {
+        const Counters& c = counters[t];
+        if (!c.opens)
+            continue;
+        snprintf(line, sizeof(line), "%s: %llu opens (%llu shared), %.1f MB, %.0f ms", name(Type(t)),
+            (unsigned long long)c.opens, (unsigned long long)c.shared, c.bytes / 1048576.0, c.nanoseconds * 1e-6);
+        lines.push_back(line);
+    }
+
+    // codec and read times on one line, they overlap with the open times above
+    string stages;
+    const char* codec;
+    uint64_t calls, inBytes, outBytes, nanoseconds;
+    for (uint32 c = 0; libmpq__codec_stats(c, &codec, &calls, &inBytes, &outBytes, &nanoseconds) == 0; ++c)
+    {
+        if (!calls)
+            continue;
+        snprintf(line, sizeof(line), "%s%s %.0f ms", stages.empty() ? "" : ", ", codec, nanoseconds * 1e-6);
+        stages += line;
+    }
+    if (!stages.empty())
+        lines.push_back(stages);
+}
+
+MPQFile::MPQFile(const char* filename, bool streaming) :
+    eof(false),
+    buffer(0),
+    pointer(0),
+    size(0),
+    stream(0),
+    streamFile(0),
+    sectorClock(0),
+    statType(MPQStats::TYPES),
+    readBytes(0),
+    inflating(false)
+{
+    if (trace)
+        record(filename);
+
+    if (!MPQStats::isEnabled())
+    {
+        open(filename, streaming);
+        return;
+    }
+
+    statType = MPQStats::typeOf(filename);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    mpq_archive_s* archive = open(filename, streaming);
+    bool found = archive || !view.empty();
+    MPQStats::opened(statType, archive, found, found && !stream && !inflating, readBytes, size, start);
+}
+
+mpq_archive_s* MPQFile::open(const char* filename, bool streaming)
+{
+    // loose files override everything, so modified files can be dropped in without repacking
+    if (MPQLoose::find(filename, view) || MPQPack::find(filename, view))
+    {
+        size = view.size;
+        readBytes = size;
+        eof = size == 0;
+        return 0;
+    }
+
+    if (MPQIndex::isBuilt())
+    {
+        mpq_archive_s* mpq_a;
+        uint32 filenum;
+        if (MPQIndex::find(filename, mpq_a, filenum))
+        {
+            load(mpq_a, filenum, streaming);
+            return mpq_a;
+        }
+    }
+    else
+    {
+        for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
+        {
+            mpq_archive* mpq_a = (*i)->mpq_a;
+
+            uint32 filenum;
+            if (libmpq__file_number(mpq_a, filename, &filenum)) continue;
+            load(mpq_a, filenum, streaming);
+            return mpq_a;
+        }
     }
     eof = true;
     buffer = 0;
+    return 0;
+}
+
+MPQFile::MPQFile(const MPQView& view) :
+    eof(view.size == 0),
+    buffer(0),
+    view(view),
+    pointer(0),
+    size(view.size),
+    stream(0),
+    streamFile(0),
+    sectorClock(0),
+    statType(MPQStats::TYPES),
+    readBytes(0),
+    inflating(false)
+{
+}
+
+void MPQFile::load(mpq_archive_s* mpq_a, uint32 filenum, bool streaming)
+{
+    libmpq__file_unpacked_size(mpq_a, filenum, &size);
+
+    // HACK: in patch.mpq some files don't want to open and give 1 for filesize
+    if (size <= 1)
+    {
+        // printf("info: file %s has size %d; considered dummy file.\n", filename, size);
+        eof = true;
+        buffer = 0;
+        return;
+    }
+
+    // stored files in a mapped archive are used in place, the mapping lives as long as the archive
+    const uint8_t* raw;
+    libmpq__off_t rawSize;
+    if (libmpq__file_pointer(mpq_a, filenum, &raw, &rawSize) == 0 && rawSize == size)
+    {
+        view.data = (const char*)raw;
+        view.size = (size_t)size;
+        readBytes = size;
+        return;
+    }
+
+    view = MPQCache::fetch(mpq_a, filenum, size, streaming);
+    if (!view.empty())
+        return;
+
+    if (streaming && libmpq__block_open_offset(mpq_a, filenum) == 0)
+    {
+        uint32 blocks;
+        libmpq__file_blocks(mpq_a, filenum, &blocks);
+
+        blockStart.resize(blocks + 1);
+        blockStart[0] = 0;
+        for (uint32 b = 0; b < blocks; ++b)
+        {
+            libmpq__off_t blockSize;
+            libmpq__block_unpacked_size(mpq_a, filenum, b, &blockSize);
+            blockStart[b + 1] = blockStart[b] + blockSize;
+        }
+
+        for (int i = 0; i < STREAM_SECTORS; ++i)
+        {
+            sectors[i].block = 0xFFFFFFFF;
+            sectors[i].lastUse = 0;
+        }
+
+        stream = mpq_a;
+        streamFile = filenum;
+        return;
+    }
+
+    inflating = true;
+    if (statType != MPQStats::TYPES)
+        libmpq__file_packed_size(mpq_a, filenum, &readBytes);
+
+    // with a cache the inflated bytes are shared with it, writers get their own copy on first use
+    if (MPQCache::getBudget())
+    {
+        std::shared_ptr<std::vector<char>> data = std::make_shared<std::vector<char>>((size_t)size);
+        if (readFile(mpq_a, filenum, &(*data)[0], size, pool != 0))
+            MPQCache::store(mpq_a, filenum, data);
+        view.data = &(*data)[0];
+        view.size = (size_t)size;
+        view.owner = data;
+        return;
+    }
+
+    buffer = new char[size];
+
+    //libmpq_file_getdata
+    readFile(mpq_a, filenum, buffer, size, pool != 0);
+    /*libmpq_file_getdata(&mpq_a, hash, fileno, (unsigned char*)buffer);*/
+}
+
+ThreadPool* MPQFile::pool = 0;
+ThreadPool* MPQFile::ioPool = 0;
+FILE* MPQFile::trace = 0;
+std::mutex MPQFile::traceLock;
+
+bool MPQFile::setTrace(const char* filename)
+{
+    std::lock_guard<std::mutex> guard(traceLock);
+    if (trace) fclose(trace);
+    trace = filename ? fopen(filename, "w") : 0;
+    return trace != 0;
+}
+
+void MPQFile::record(const char* filename)
+{
+    static std::unordered_set<uint64> seen;
+
+    std::lock_guard<std::mutex> guard(traceLock);
+    if (trace && seen.insert(MPQIndex::key(filename)).second)
+    {
+        fprintf(trace, "%s\n", filename);
+        fflush(trace);
+    }
+}
+
+void MPQFile::setDecompressThreads(unsigned threads)
+{
+    delete pool;
+    pool = threads ? new ThreadPool(threads) : 0;
+}
+
+void MPQFile::setIOThreads(unsigned threads)
+{
+    // queued requests are still served (or dropped if cancelled) before the old threads exit
+    delete ioPool;
+    ioPool = threads ? new ThreadPool(threads) : 0;
+}
+
+MPQRequest MPQFile::openAsync(const char* filename, int priority, std::function<void(const MPQView&)> done)
+{
+    MPQRequest request;
+    std::shared_ptr<MPQRequest::State> state = std::make_shared<MPQRequest::State>();
+    state->filename = filename;
+    state->cancelled = false;
+    state->result = state->promise.get_future().share();
+    state->done = std::move(done);
+    request.state = state;
+
+    // the callback runs before the future becomes ready, so whatever it produces is there for get()
+    std::function<void()> job = [state]()
+    {
+        MPQView view;
+        if (!state->cancelled)
+        {
+            MPQFile f(state->filename.c_str());
+            view = f.getView();
+            if (state->done && !state->cancelled)
+                state->done(view);
+        }
+        state->done = nullptr;
+        state->promise.set_value(view);
+    };
+
+    if (ioPool)
+        ioPool->post(job, priority);
+    else
+        job();
+    return request;
+}
+
+bool MPQFile::readFile(mpq_archive_s* mpq_a, uint32 filenum, char* dest, libmpq__off_t size, bool parallel)
+{
+    libmpq__off_t transferred;
+    uint32 blocks;
+    libmpq__file_blocks(mpq_a, filenum, &blocks);
+
+    if (!parallel || !pool || blocks < PARALLEL_MIN_BLOCKS)
+        return libmpq__file_read(mpq_a, filenum, (unsigned char*)dest, size, &transferred) == 0;
+
+    if (libmpq__block_open_offset(mpq_a, filenum))
+        return false;
+
+    // every participant pulls the next sector index until all are taken; the state is shared
+    // so helpers that only start after the caller returned find nothing left and exit
+    struct Job
+    {
+        mpq_archive_s* archive;
+        uint32 filenum, blocks;
+        char* dest;
+        std::vector<libmpq__off_t> start;
+        std::atomic<uint32> next, done;
+        std::atomic<bool> failed;
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->archive = mpq_a;
+    job->filenum = filenum;
+    job->blocks = blocks;
+    job->dest = dest;
+    job->next = 0;
+    job->done = 0;
+    job->failed = false;
+    job->start.resize(blocks + 1);
+    job->start[0] = 0;
+    for (uint32 b = 0; b < blocks; ++b)
+    {
+        libmpq__off_t blockSize;
+        libmpq__block_unpacked_size(mpq_a, filenum, b, &blockSize);
+        job->start[b + 1] = job->start[b] + blockSize;
+    }
+
+    std::function<void()> work = [job]()
+    {
+        for (uint32 b; (b = job->next++) < job->blocks; )
+        {
+            libmpq__off_t transferred;
+            if (libmpq__block_read(job->archive, job->filenum, b, (uint8_t*)job->dest + job->start[b], job->start[b + 1] - job->start[b], &transferred))
+                job->failed = true;
+
+            if (++job->done == job->blocks)
+            {
+                std::lock_guard<std::mutex> guard(job->lock);
+                job->finished.notify_all();
+            }
+        }
+    };
+
+    unsigned helpers = std::min(pool->size(), blocks - 1);
+    for (unsigned i = 0; i < helpers; ++i)
+        pool->post(work);
+
+    // the caller decompresses as well, so this also makes progress when called from a pool thread
+    work();
+    {
+        std::unique_lock<std::mutex> guard(job->lock);
+        job->finished.wait(guard, [&job]() { return job->done == job->blocks; });
+    }
+
+    libmpq__block_close_offset(mpq_a, filenum);
+    return !job->failed;
+}
+
+// index first, then the archives in priority order
+static bool locateFile(const char* filename, mpq_archive_s*& mpq_a, uint32& filenum)
+{
+    if (MPQIndex::find(filename, mpq_a, filenum))
+        return true;
+    for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
+    {
+        if (libmpq__file_number((*i)->mpq_a, filename, &filenum) == 0)
+        {
+            mpq_a = (*i)->mpq_a;
+            return true;
+        }
+    }
+    return false;
+}
+
+// every sector through libmpq__block_read, so concurrent callers share the archive's file handle
+static bool readBlocks(mpq_archive_s* mpq_a, uint32 filenum, std::vector<char>& dest)
+{
+    libmpq__off_t size;
+    uint32 blocks;
+    libmpq__file_unpacked_size(mpq_a, filenum, &size);
+    libmpq__file_blocks(mpq_a, filenum, &blocks);
+    dest.resize((size_t)size);
+    if (libmpq__block_open_offset(mpq_a, filenum))
+        return false;
+
+    bool ok = true;
+    libmpq__off_t offset = 0;
+    for (uint32 b = 0; b < blocks && ok; ++b)
+    {
+        libmpq__off_t blockSize, transferred;
+        libmpq__block_unpacked_size(mpq_a, filenum, b, &blockSize);
+        ok = offset + blockSize <= size &&
+            libmpq__block_read(mpq_a, filenum, b, (uint8_t*)&dest[0] + offset, blockSize, &transferred) == 0;
+        offset += blockSize;
+    }
+    libmpq__block_close_offset(mpq_a, filenum);
+    return ok;
+}
+
+// names from a list with one per line, e.g. written by -mpqtrace; names found nowhere are skipped
+struct ListedFile
+{
+    std::string name;
+    mpq_archive_s* mpq_a;
+    uint32 filenum;
+    std::vector<char> reference;
+};
+
+static bool readList(const char* listfile, std::vector<ListedFile>& files)
+{
+    FILE* f = fopen(listfile, "r");
+    if (!f)
+        return false;
+
+    char line[512];
+    while (fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        ListedFile e;
+        if (!*line || !locateFile(line, e.mpq_a, e.filenum))
+            continue;
+        e.name = line;
+        files.push_back(e);
+    }
+    fclose(f);
+    return true;
+}
+
+bool MPQFile::stress(const char* listfile, unsigned threads, int rounds)
+{
+    std::vector<ListedFile> files;
+    if (!readList(listfile, files))
+    {
+        printf("Stress: cannot open %s\n", listfile);
+        return false;
+    }
+
+    // single threaded reference
+    size_t total = 0;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (!readBlocks(files[i].mpq_a, files[i].filenum, files[i].reference))
+            printf("Stress: %s could not be read\n", files[i].name.c_str());
+        total += files[i].reference.size();
+    }
+    printf("Stress: %u files, %.1f MB, %u threads, %d rounds\n", (unsigned)files.size(), total / 1048576.0, threads, rounds);
+    if (files.empty())
+        return false;
+
+    // each thread walks the list from a different start, so the same files and archives are read at once
+    std::atomic<unsigned> mismatches(0), failures(0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.push_back(std::thread([&files, &mismatches, &failures, t, threads, rounds]()
+        {
+            std::vector<char> data;
+            for (int r = 0; r < rounds; ++r)
+            {
+                for (size_t n = 0; n < files.size(); ++n)
+                {
+                    const ListedFile& e = files[(n + t * files.size() / threads) % files.size()];
+                    if (!readBlocks(e.mpq_a, e.filenum, data))
+                        failures++;
+                    else if (data.size() != e.reference.size() || (!data.empty() && memcmp(&data[0], &e.reference[0], data.size())))
+                    {
+                        if (mismatches++ < 10)
+                            printf("Stress: %s differs on thread %u\n", e.name.c_str(), t);
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("  %8.1f MB/s, %u mismatches, %u failed reads\n", seconds > 0 ? (double(total) * rounds * threads / (1 << 20)) / seconds : 0.0,
+        mismatches.load(), failures.load());
+    return mismatches == 0 && failures == 0;
+}
+
+bool MPQFile::compare(const char* listfile)
+{
+    std::vector<ListedFile> files;
+    if (!readList(listfile, files))
+    {
+        printf("Compare: cannot open %s\n", listfile);
+        return false;
+    }
+
+    // every file with the reference decoders, then with the fast ones; both read sector by sector
+    std::vector<char> data;
+    unsigned differ = 0, failed = 0;
+    size_t total = 0;
+    double seconds[2] = { 0, 0 };
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        ListedFile& e = files[i];
+        bool ok = true;
+        for (int fast = 0; fast < 2; ++fast)
+        {
+            libmpq__codec_reference(fast == 0);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ok = readBlocks(e.mpq_a, e.filenum, fast ? data : e.reference) && ok;
+            seconds[fast] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        if (!ok)
+        {
+            failed++;
+            printf("Compare: %s could not be read\n", e.name.c_str());
+        }
+        else if (data != e.reference)
+        {
+            if (differ++ < 10)
+                printf("Compare: %s differs\n", e.name.c_str());
+        }
+        total += data.size();
+        std::vector<char>().swap(e.reference);
+    }
+    libmpq__codec_reference(0);
+
+    printf("Compare: %u files, %.1f MB, reference %.1f MB/s, fast %.1f MB/s, %u differ, %u failed reads\n",
+        (unsigned)files.size(), total / 1048576.0, seconds[0] > 0 ? total / 1048576.0 / seconds[0] : 0.0,
+        seconds[1] > 0 ? total / 1048576.0 / seconds[1] : 0.0, differ, failed);
+    return !files.empty() && differ == 0 && failed == 0;
+}
+
+bool MPQFile::benchmark(const char* filename, int rounds)
+{
+    mpq_archive_s* mpq_a = 0;
+    uint32 filenum;
+    if (!locateFile(filename, mpq_a, filenum))
+    {
+        printf("Benchmark: %s not found\n", filename);
+        return false;
+    }
+
+    libmpq__off_t size;
+    uint32 blocks;
+    libmpq__file_unpacked_size(mpq_a, filenum, &size);
+    libmpq__file_blocks(mpq_a, filenum, &blocks);
+    std::vector<char> dest((size_t)size), reference((size_t)size);
+
+    printf("Benchmark: %s, %lld bytes in %u sectors, %u threads\n", filename, (long long)size, blocks, pool ? pool->size() : 0);
+    // the fast decoders serially and in parallel, then the reference decoders they replaced, serially
+    static const char* const passes[] = { "serial", "parallel", "reference" };
+    for (int pass = 0; pass < 3; ++pass)
+    {
+        bool parallel = pass == 1;
+
+        // codecs, decryption and key search are timed on the serial passes only, so their numbers are not
+        // skewed by contention; seeds are cached per archive, so a key search only shows on the first open
+        libmpq__codec_timing(!parallel);
+        libmpq__codec_reference(pass == 2);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+            readFile(mpq_a, filenum, pass == 2 ? &reference[0] : &dest[0], size, parallel);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("  %-9s %8.1f MB/s\n", passes[pass], seconds > 0 ? (double(size) * rounds / (1 << 20)) / seconds : 0.0);
+
+        const char* name;
+        uint64_t calls, inBytes, outBytes, nanoseconds;
+        for (uint32 c = 0; !parallel && libmpq__codec_stats(c, &name, &calls, &inBytes, &outBytes, &nanoseconds) == 0; ++c)
+        {
+            if (calls)
+                printf("    %-12s %8llu calls %8.1f MB/s out %8.2f us/call, ratio %.2f\n", name, (unsigned long long)calls,
+                    nanoseconds ? (double(outBytes) / (1 << 20)) / (nanoseconds * 1e-9) : 0.0, nanoseconds * 1e-3 / calls,
+                    inBytes ? double(outBytes) / inBytes : 0.0);
+        }
+    }
+    libmpq__codec_reference(0);
+    libmpq__codec_timing(0);
+
+    bool same = dest == reference;
+    printf("  reference decoders: %s\n", same ? "identical output" : "output differs");
+    return same;
+}
+
+MPQFile::Sector* MPQFile::getSector(uint32 block)
+{
+    // least recently used slot gets replaced
+    Sector* victim = &sectors[0];
+    for (int i = 0; i < STREAM_SECTORS; ++i)
+    {
+        if (sectors[i].block == block)
+        {
+            sectors[i].lastUse = ++sectorClock;
+            return &sectors[i];
+        }
+        if (sectors[i].lastUse < victim->lastUse)
+            victim = &sectors[i];
+    }
+
+    libmpq__off_t transferred, packed = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // untagged until the read succeeds, a failed read must not leave the old tag on the new bytes
+    victim->block = 0xFFFFFFFF;
+    victim->data.resize((size_t)(blockStart[block + 1] - blockStart[block]));
+    if (libmpq__block_read(stream, streamFile, block, (uint8_t*)&victim->data[0], victim->data.size(), &transferred))
+        return 0;
+    if (statType != MPQStats::TYPES)
+    {
+        libmpq__block_packed_size(stream, streamFile, block, &packed);
+        MPQStats::inflated(statType, packed, transferred, start);
+    }
+
+    victim->block = block;
+    victim->lastUse = ++sectorClock;
+    return victim;
+}
+
+void MPQFile::materialize()
+{
+    libmpq__off_t transferred;
+    if (!stream && view.empty())
+        return;
+
+    buffer = new char[size];
+
+    // shared bytes are read-only, the view is kept so earlier getConstBuffer() pointers stay valid
+    if (!view.empty())
+    {
+        memcpy(buffer, view.data, size);
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (libmpq__file_read(stream, streamFile, (unsigned char*)buffer, size, &transferred) == 0)
+        MPQCache::store(stream, streamFile, buffer, size);
+    if (statType != MPQStats::TYPES)
+    {
+        // the whole file is read again, sectors streamed before included
+        libmpq__off_t packed = 0;
+        libmpq__file_packed_size(stream, streamFile, &packed);
+        MPQStats::inflated(statType, packed, size, start);
+    }
+
+    // from here on the file behaves like a fully loaded one
+    libmpq__block_close_offset(stream, streamFile);
+    stream = 0;
+    blockStart.clear();
+    for (int i = 0; i < STREAM_SECTORS; ++i)
+        std::vector<char>().swap(sectors[i].data);
 }
 
 size_t MPQFile::read(void* dest, size_t bytes)
@@ -106,13 +1120,61 @@ size_t MPQFile::read(void* dest, size_t bytes)
         eof = true;
     }
 
-    memcpy(dest, &(buffer[pointer]), bytes);
+    if (buffer)
+        memcpy(dest, &(buffer[pointer]), bytes);
+    else if (!view.empty())
+        memcpy(dest, view.data + pointer, bytes);
+    else if (stream)
+    {
+        // sector sizes are fixed except for the last one, so the first sector is found by upper_bound
+        char* out = (char*)dest;
+        libmpq__off_t pos = pointer;
+        size_t left = bytes;
+        uint32 block = (uint32)(std::upper_bound(blockStart.begin(), blockStart.end(), pos) - blockStart.begin()) - 1;
+        while (left > 0)
+        {
+            Sector* sector = getSector(block);
+            if (!sector)
+            {
+                memset(out, 0, left);
+                break;
+            }
+
+            size_t offset = (size_t)(pos - blockStart[block]);
+            size_t count = sector->data.size() - offset;
+            if (count > left) count = left;
+            memcpy(out, &sector->data[offset], count);
+
+            out += count;
+            pos += count;
+            left -= count;
+            ++block;
+        }
+    }
 
     pointer = rpos;
 
     return bytes;
 }
 
+MPQView MPQFile::getView()
+{
+    if (stream)
+        materialize();
+
+    // private bytes move into shared ownership, a later getBuffer() makes a fresh copy;
+    // the bytes they were copied from stay alive for pointers taken before the copy
+    if (buffer)
+    {
+        std::shared_ptr<const void> previous = view.owner;
+        view.owner = std::shared_ptr<char>(buffer, [previous](char* p) { delete[] p; });
+        view.data = buffer;
+        view.size = (size_t)size;
+        buffer = 0;
+    }
+    return view;
+}
+
 void MPQFile::seek(int offset)
 {
     pointer = offset;
@@ -127,6 +1189,9 @@ void MPQFile::seekRelative(int offset)
 
 void MPQFile::close()
 {
+    if (stream) libmpq__block_close_offset(stream, streamFile);
+    stream = 0;
+    view = MPQView();
     if (buffer) delete[] buffer;
     buffer = 0;
     eof = true;
@@ -29,6 +29,15 @@
 #include <vector>
 #include <iostream>
 #include <deque>
+#include <unordered_map>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <string>
+#include <functional>
 
 using namespace std;
 
@@ -37,6 +46,10 @@ class MPQArchive
 
     public:
         mpq_archive_s* mpq_a;
+        string filename;
+
+        // LIBMPQ_OPEN_* flags used by archives opened afterwards (e.g. LIBMPQ_OPEN_MMAP)
+        static uint32 openFlags;
 
         MPQArchive(const char* filename);
         void close();
@@ -71,30 +84,274 @@ class MPQArchive
         }
 };
 typedef std::deque<MPQArchive*> ArchiveSet;
+extern ArchiveSet gOpenArchives;
+
+// Lookup table over all open archives keyed by the two name hashes of a file.
+// Built once after the archives are opened, the first archive in gOpenArchives wins,
+// so a lookup (or a miss) is a single probe instead of a hash table walk per archive.
+class MPQIndex
+{
+    public:
+        static void build();
+        static void clear();
+        static bool isBuilt() { return built; }
+        static bool find(const char* filename, mpq_archive_s*& archive, uint32& filenum);
+        // both name hashes of the normalized path, also used to key the pack index
+        static uint64 key(const char* filename);
+
+    private:
+        struct Entry
+        {
+            mpq_archive_s* archive;
+            uint32 filenum;
+            uint16 locale;
+        };
+
+        static std::unordered_map<uint64, Entry> entries;
+        static bool built;
+};
+
+// Read-only window on the bytes of a file. The owner keeps the memory alive for as long as the
+// view exists; it is empty when the bytes live as long as the archives (archive or pack mapping).
+struct MPQView
+{
+    const char* data;
+    size_t size;
+    std::shared_ptr<const void> owner;
+
+    MPQView() : data(0), size(0) {}
+    bool empty() const { return data == 0; }
+};
+
+// LRU of decompressed files keyed by archive and file number, shared by all MPQFile users.
+// A hit returns a view of the cached bytes, an entry evicted while viewed stays alive until
+// the last view is gone. Streamed files only enter the cache once they are read as a whole,
+// so a streamed open that finds nothing counts as a bypass rather than a miss.
+class MPQCache
+{
+    public:
+        struct Stats
+        {
+            uint64 hits, misses, bypasses, evictions;
+            uint64 bytes, files;
+        };
+
+        static void setBudget(uint64 bytes);
+        static uint64 getBudget() { return budget; }
+        static MPQView fetch(mpq_archive_s* archive, uint32 filenum, libmpq__off_t size, bool streaming = false);
+        static void store(mpq_archive_s* archive, uint32 filenum, const std::shared_ptr<std::vector<char>>& data);
+        static void store(mpq_archive_s* archive, uint32 filenum, const char* data, libmpq__off_t size);
+        static void clear();
+        static Stats getStats();
+
+    private:
+        struct Key
+        {
+            mpq_archive_s* archive;
+            uint32 filenum;
+            bool operator==(const Key& k) const { return archive == k.archive && filenum == k.filenum; }
+        };
+        struct KeyHash
+        {
+            size_t operator()(const Key& k) const { return std::hash<void*>()(k.archive) ^ (size_t(k.filenum) * 0x9E3779B9u); }
+        };
+        struct Node
+        {
+            Key key;
+            std::shared_ptr<std::vector<char>> data;
+        };
+        typedef std::list<Node> NodeList;
+
+        static void evict(uint64 limit);
+
+        static std::atomic<uint64> budget;     // read without the lock by fetch and getBudget
+        static NodeList lru;                    // most recently used first
+        static std::unordered_map<Key, NodeList::iterator, KeyHash> nodes;
+        static Stats stats;
+        static std::mutex lock;
+};
+
+// Merged listfile of all open archives, built on first use. Names are normalized to upper
+// case with backslashes and kept sorted, so a prefix is one contiguous range; a per-extension
+// list of the same order answers "all *.blp under Tileset\\" without scanning other names.
+class MPQDirectory
+{
+    public:
+        static void build();
+        static void clear();
+        static size_t size();
+        // names starting with prefix (may be empty), optionally only those ending in extension ("blp" or ".blp")
+        static void find(const char* prefix, const char* extension, vector<string>& result);
+
+    private:
+        static string normalize(const char* name, size_t length);
+        static void buildLocked();
+
+        static vector<string> names;
+        static std::unordered_map<string, vector<uint32>> byExtension;     // indices into names, ascending
+        static bool built;
+        static std::mutex lock;
+};
+
+// Telemetry of the MPQ layer, collected while enabled. Opens are grouped by file type; codec,
+// decryption and archive read times come from libmpq and cover all types.
+class MPQStats
+{
+    public:
+        enum Type { ADT, BLP, M2, WMO, DBC, OTHER, TYPES };
+
+        struct Counters
+        {
+            uint64 opens, misses;       // misses were found nowhere
+            uint64 shared;              // served without inflating: pack, archive mapping or cache
+            uint64 bytes;               // unpacked size of everything opened
+            uint64 readBytes;           // bytes read from archives, packs and loose files, streamed sectors included
+            uint64 inflatedBytes;       // what those bytes unpacked to, the same amount where used in place
+            uint64 nanoseconds;         // time spent opening, streamed sectors included
+        };
+
+        // enabling also turns on the libmpq timing and resets all counters
+        static void enable(bool on);
+        static bool isEnabled() { return enabled; }
+        static Type typeOf(const char* filename);
+        static const char* name(Type type);
+        static Counters get(Type type);
+        // everything, per type, per archive and per codec
+        static void dump();
+        // a few lines for the on-screen overlay
+        static void summary(vector<string>& lines);
+
+    private:
+        friend class MPQFile;
+
+        static void opened(Type type, mpq_archive_s* archive, bool found, bool shared, libmpq__off_t readBytes,
+            libmpq__off_t bytes, std::chrono::steady_clock::time_point start);
+        static void inflated(Type type, libmpq__off_t readBytes, libmpq__off_t bytes,
+            std::chrono::steady_clock::time_point start);
+
+        static std::atomic<bool> enabled;
+        static Counters counters[TYPES];
+        static std::unordered_map<mpq_archive_s*, uint64> archiveHits;
+        static std::mutex lock;
+};
+
+class ThreadPool;
+
+// Handle of a file opened by MPQFile::openAsync. Copies share one request; the view is empty
+// when the file does not exist or the request was cancelled before an I/O thread picked it up.
+class MPQRequest
+{
+    public:
+        MPQRequest() {}
+
+        bool isValid() const { return state != 0; }
+        bool isReady() const { return state && state->result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+        // blocks until the file is loaded
+        MPQView get() const { return state ? state->result.get() : MPQView(); }
+        const std::shared_future<MPQView>& getFuture() const { return state->result; }
+
+        // stale requests are dropped if they have not started yet, a running load still completes
+        void cancel() { if (state) state->cancelled = true; }
+        bool isCancelled() const { return state && state->cancelled; }
+
+    private:
+        friend class MPQFile;
+
+        struct State
+        {
+            std::string filename;
+            std::atomic<bool> cancelled;
+            std::promise<MPQView> promise;
+            std::shared_future<MPQView> result;
+            std::function<void(const MPQView&)> done;
+        };
+        std::shared_ptr<State> state;
+};
 
 class MPQFile
 {
         //MPQHANDLE handle;
         bool eof;
-        char* buffer;
+        char* buffer;           // private bytes, callers may patch them in place
+        MPQView view;           // shared read-only bytes, used while there is no private buffer
         libmpq__off_t pointer, size;
 
+        // streaming mode: only the sectors touched by read() are decompressed
+        struct Sector
+        {
+            uint32 block;
+            uint32 lastUse;
+            std::vector<char> data;
+        };
+        enum { STREAM_SECTORS = 4 };
+
+        mpq_archive_s* stream;
+        uint32 streamFile;
+        std::vector<libmpq__off_t> blockStart;    // unpacked offset of every sector plus the file end
+        Sector sectors[STREAM_SECTORS];
+        uint32 sectorClock;
+
+        MPQStats::Type statType;    // TYPES while telemetry is off
+        libmpq__off_t readBytes;    // bytes read from disk when opened, packed ones if inflated
+        bool inflating;             // readBytes were inflated rather than used in place
+
         // disable copying
         MPQFile(const MPQFile& f) {}
         void operator=(const MPQFile& f) {}
 
+        mpq_archive_s* open(const char* filename, bool streaming);
+        void load(mpq_archive_s* mpq_a, uint32 filenum, bool streaming);
+        Sector* getSector(uint32 block);
+        void materialize();
+
+        // files with at least this many sectors are inflated on the decompression pool
+        enum { PARALLEL_MIN_BLOCKS = 8 };
+        static ThreadPool* pool;
+        static ThreadPool* ioPool;
+        static FILE* trace;
+        static std::mutex traceLock;
+        static void record(const char* filename);
+        static bool readFile(mpq_archive_s* mpq_a, uint32 filenum, char* dest, libmpq__off_t size, bool parallel);
+
     public:
-        MPQFile(const char* filename);    // filenames are not case sensitive
+        MPQFile(const char* filename, bool streaming = false);    // filenames are not case sensitive
+        explicit MPQFile(const MPQView& view);                       // reads bytes loaded elsewhere, e.g. by openAsync
         ~MPQFile() { close(); }
         size_t read(void* dest, size_t bytes);
         size_t getSize() { return size; }
         size_t getPos() { return pointer; }
-        char* getBuffer() { return buffer; }
-        char* getPointer() { return buffer + pointer; }
+        // writable access needs a private copy of the whole file, it is made on first use
+        char* getBuffer() { if (!buffer) materialize(); return buffer; }
+        char* getPointer() { if (!buffer) materialize(); return buffer + pointer; }
+        // read-only access, shared bytes are used as they are
+        const char* getConstBuffer() { if (stream) materialize(); return buffer ? buffer : view.data; }
+        const char* getConstPointer() { return getConstBuffer() + pointer; }
+        // the file bytes with their own lifetime, usable after the file is closed
+        MPQView getView();
         bool isEof() { return eof; }
         void seek(int offset);
         void seekRelative(int offset);
         void close();
+
+        // 0 threads decompresses every file on the calling thread
+        static void setDecompressThreads(unsigned threads);
+        // 0 threads loads asynchronous requests on the calling thread, before openAsync returns
+        static void setIOThreads(unsigned threads);
+        // loads the whole file on an I/O thread, higher priorities first; the callback (if any)
+        // runs on that thread once the file is loaded, it is not called for cancelled requests
+        static MPQRequest openAsync(const char* filename, int priority = 0, std::function<void(const MPQView&)> done = nullptr);
+        // reads one file serially and in parallel and prints the throughput of both, and of each codec,
+        // decryption and key search on the serial pass; then once more with the reference decoders
+        // (libmpq__codec_reference) for their throughput, false if their output differs
+        static bool benchmark(const char* filename, int rounds);
+        // reads every file named in the list (one per line) with the reference decoders and the fast ones
+        // and compares the bytes; false on any difference or failed read
+        static bool compare(const char* listfile);
+        // reads every file named in the list (one per line) sector by sector on one thread, then on
+        // threads threads at once, each pass repeated rounds times, and compares the bytes; false on any mismatch
+        static bool stress(const char* listfile, unsigned threads, int rounds);
+        // appends the name of every file opened from now on to the given file, once per name
+        static bool setTrace(const char* filename);
 };
 
 inline void flipcc(char* fcc)
@@ -0,0 +1,147 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include "mpqloose.h"
+#include "mpqpack.h"
+#include "threadpool.h"
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+
+std::unordered_map<uint64, string> MPQLoose::files;
+
+bool MPQLoose::open(const char* directory)
+{
+    close();
+
+    std::error_code ec;
+    std::filesystem::path root(directory);
+    for (std::filesystem::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (!it->is_regular_file(ec))
+            continue;
+
+        // the key hashes the relative path with backslashes, the way the archives name it
+        string name = it->path().lexically_relative(root).string();
+        std::replace(name.begin(), name.end(), '/', '\\');
+        files[MPQIndex::key(name.c_str())] = it->path().string();
+    }
+
+    if (ec)
+        printf("Could not scan loose files in '%s'\n", directory);
+    printf("Serving %u loose files from %s\n", (unsigned)files.size(), directory);
+    return !ec;
+}
+
+void MPQLoose::close()
+{
+    files.clear();
+}
+
+bool MPQLoose::find(const char* filename, MPQView& view)
+{
+    if (files.empty())
+        return false;
+
+    std::unordered_map<uint64, string>::const_iterator it = files.find(MPQIndex::key(filename));
+    if (it == files.end())
+        return false;
+
+    // empty or vanished files fall through to the archives
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(it->second.c_str()))
+        return false;
+
+    view.data = file->getData();
+    view.size = file->getSize();
+    view.owner = file;
+    return true;
+}
+
+bool MPQLoose::extract(const char* directory, unsigned threads)
+{
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // the merged listfile names every file once, MPQFile resolves patch priority
+    vector<string> names;
+    MPQDirectory::find("", "", names);
+    printf("Extracting %u listed files to %s on %u threads\n", (unsigned)names.size(), directory, threads);
+
+    std::filesystem::path root(directory);
+    std::atomic<size_t> next(0), done(0), missing(0), failed(0), unsafe(0);
+    std::atomic<uint64> bytes(0);
+    std::mutex lock;
+    std::condition_variable finished;
+
+    std::function<void()> work = [&]()
+    {
+        for (size_t i; (i = next++) < names.size(); )
+        {
+            // listfiles are not trusted, no name may leave the directory
+            string relative = names[i];
+            std::replace(relative.begin(), relative.end(), '\\', '/');
+            std::filesystem::path path(relative);
+            bool escapes = path.is_absolute() || path.has_root_name() || path.has_root_directory();
+            for (std::filesystem::path::const_iterator part = path.begin(); !escapes && part != path.end(); ++part)
+                escapes = *part == "..";
+
+            if (escapes)
+            {
+                printf("  skipped unsafe name %s\n", names[i].c_str());
+                ++unsafe;
+            }
+            else
+            {
+                MPQFile f(names[i].c_str());
+                if (f.isEof())
+                    ++missing;
+                else
+                {
+                    path = root / path;
+
+                    std::error_code ec;
+                    std::filesystem::create_directories(path.parent_path(), ec);
+                    FILE* out = fopen(path.string().c_str(), "wb");
+                    bool ok = out && fwrite(f.getConstBuffer(), 1, f.getSize(), out) == f.getSize();
+                    ok = out && fclose(out) == 0 && ok;
+                    if (ok)
+                        bytes += f.getSize();
+                    else
+                    {
+                        printf("  could not write %s\n", path.string().c_str());
+                        ++failed;
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (++done == names.size())
+                finished.notify_all();
+        }
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (unsigned t = 0; t < threads; ++t)
+            pool.post(work);
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (!finished.wait_for(guard, std::chrono::seconds(1), [&]() { return done == names.size(); }))
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("  %u/%u files, %llu MB, %.1f MB/s\n", (unsigned)done, (unsigned)names.size(),
+                (unsigned long long)(bytes >> 20), (bytes / 1048576.0) / seconds);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Extracted %u files (%llu MB) in %.1f s, %.1f MB/s, %u listed files not found, %u not written, %u unsafe names skipped\n",
+        (unsigned)(names.size() - missing - failed - unsafe), (unsigned long long)(bytes >> 20), seconds,
+        seconds > 0 ? (bytes / 1048576.0) / seconds : 0.0, (unsigned)missing, (unsigned)failed, (unsigned)unsafe);
+    return failed == 0;
+}
@@ -0,0 +1,28 @@
+#ifndef MPQLOOSE_H
+#define MPQLOOSE_H
+
+#include "mpq_libmpq.h"
+#include <unordered_map>
+
+// Directory tree of plain files served ahead of the pack and the archives, mapped read-only
+// so nothing is decompressed or copied. The tree is scanned once by open() and keyed like
+// the archives (MPQIndex::key), so names match without regard to case or separator and a
+// miss costs no file system access. Files dropped in while running are not seen until the
+// next open().
+class MPQLoose
+{
+    public:
+        static bool open(const char* directory);
+        static void close();
+        static bool isOpen() { return !files.empty(); }
+        // views keep their mapping alive, so close() does not invalidate files still in use
+        static bool find(const char* filename, MPQView& view);
+
+        // writes every listed file, resolved through the open archives, below the directory
+        static bool extract(const char* directory, unsigned threads);
+
+    private:
+        static std::unordered_map<uint64, string> files;    // key -> path on disk
+};
+
+#endif
@@ -0,0 +1,293 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mpqpack.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+
+bool MappedFile::open(const char* filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fh, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(fh);
+        return false;
+    }
+
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fh);
+    if (!mh)
+        return false;
+
+    void* view = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mh);
+        return false;
+    }
+
+    mapping = mh;
+    size = (size_t)fileSize.QuadPart;
+    data = (const char*)view;
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+
+    size = (size_t)st.st_size;
+    data = (const char*)view;
+#endif
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (!data)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle((HANDLE)mapping);
+#else
+    munmap((void*)data, size);
+#endif
+    data = 0;
+    size = 0;
+    mapping = 0;
+}
+
+std::shared_ptr<MappedFile> MPQPack::file;
+const MPQPack::PackEntry* MPQPack::entries = 0;
+uint32 MPQPack::files = 0;
+
+bool MPQPack::fingerprint(const MPQArchive* archive, PackArchive& result)
+{
+    memset(&result, 0, sizeof(result));
+
+    // only the name is compared, so the game directory may move without invalidating the pack
+    const char* name = archive->filename.c_str();
+    const char* separator = strrchr(name, '/');
+    if (const char* backslash = strrchr(name, '\\'))
+        separator = std::max(separator, backslash);
+    strncpy(result.name, separator ? separator + 1 : name, sizeof(result.name) - 1);
+
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(name, GetFileExInfoStandard, &info))
+        return false;
+    result.size = (uint64(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    result.mtime = (uint64(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if (stat(name, &st) < 0)
+        return false;
+    result.size = (uint64)st.st_size;
+    result.mtime = (uint64)st.st_mtime;
+#endif
+    return true;
+}
+
+bool MPQPack::open(const char* filename)
+{
+    close();
+    file = std::make_shared<MappedFile>();
+    if (!file->open(filename))
+    {
+        printf("Could not open pack '%s'\n", filename);
+        file.reset();
+        return false;
+    }
+
+    const PackHeader* header = (const PackHeader*)file->getData();
+    size_t fileSize = file->getSize();
+    bool valid = fileSize >= sizeof(PackHeader) && header->magic == PACK_MAGIC && header->version == PACK_VERSION &&
+        header->indexOffset <= fileSize && (fileSize - header->indexOffset) / sizeof(PackEntry) >= header->files;
+
+    uint64 archiveOffset = valid ? header->indexOffset + uint64(header->files) * sizeof(PackEntry) : 0;
+    valid = valid && (fileSize - archiveOffset) / sizeof(PackArchive) >= header->archives;
+
+    // file data lies between the header and the index, anything else would read past the mapping
+    const PackEntry* index = (const PackEntry*)(file->getData() + (valid ? header->indexOffset : 0));
+    for (uint32 i = 0; valid && i < header->files; ++i)
+    {
+        valid = index[i].offset >= sizeof(PackHeader) && index[i].offset <= header->indexOffset &&
+            index[i].size <= header->indexOffset - index[i].offset;
+    }
+    if (!valid)
+    {
+        printf("Pack '%s' is damaged or from another version\n", filename);
+        file.reset();
+        return false;
+    }
+
+    // a pack written from other archives (or an older patch set) would serve stale files ahead of them
+    const PackArchive* archives = (const PackArchive*)(file->getData() + archiveOffset);
+    bool current = header->archives == gOpenArchives.size();
+    for (uint32 i = 0; current && i < header->archives; ++i)
+    {
+        PackArchive a;
+        current = fingerprint(gOpenArchives[i], a) && !strncmp(a.name, archives[i].name, sizeof(a.name)) &&
+            a.size == archives[i].size && a.mtime == archives[i].mtime;
+    }
+    if (!current)
+    {
+        printf("Pack '%s' was written from other archives, repack it\n", filename);
+        file.reset();
+        return false;
+    }
+
+    entries = index;
+    files = header->files;
+    printf("Opened pack %s with %u files\n", filename, files);
+    return true;
+}
+
+void MPQPack::close()
+{
+    file.reset();
+    entries = 0;
+    files = 0;
+}
+
+bool MPQPack::find(const char* filename, MPQView& view)
+{
+    if (!files)
+        return false;
+
+    PackEntry probe;
+    probe.key = MPQIndex::key(filename);
+    const PackEntry* it = std::lower_bound(entries, entries + files, probe,
+        [](const PackEntry& a, const PackEntry& b) { return a.key < b.key; });
+    // entries were checked against the mapping when the pack was opened
+    if (it == entries + files || it->key != probe.key)
+        return false;
+
+    view.data = file->getData() + it->offset;
+    view.size = (size_t)it->size;
+    view.owner = file;
+    return true;
+}
+
+bool MPQPack::repack(const char* traceFile, const char* packFile)
+{
+    FILE* trace = fopen(traceFile, "r");
+    if (!trace)
+    {
+        printf("Could not open trace '%s'\n", traceFile);
+        return false;
+    }
+
+    FILE* out = fopen(packFile, "wb");
+    if (!out)
+    {
+        printf("Could not create pack '%s'\n", packFile);
+        fclose(trace);
+        return false;
+    }
+
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.align = PACK_ALIGN;
+
+    std::vector<PackEntry> index;
+    std::unordered_set<uint64> packed;
+    std::vector<char> padding(PACK_ALIGN, 0);
+    uint64 offset = PACK_ALIGN;
+    uint64 missing = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(&padding[0], PACK_ALIGN - sizeof(header), 1, out) == 1;
+
+    // files keep the order of the trace, so replaying the same route reads the pack front to back
+    char line[512];
+    while (ok && fgets(line, sizeof(line), trace))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if (!line[0])
+            continue;
+
+        PackEntry entry;
+        entry.key = MPQIndex::key(line);
+        if (packed.count(entry.key))
+            continue;
+
+        MPQFile f(line);
+        if (f.isEof())
+        {
+            ++missing;
+            continue;
+        }
+
+        entry.offset = offset;
+        entry.size = f.getSize();
+        index.push_back(entry);
+        packed.insert(entry.key);
+
+        size_t pad = (size_t)((PACK_ALIGN - entry.size % PACK_ALIGN) % PACK_ALIGN);
+        ok = fwrite(f.getBuffer(), 1, (size_t)entry.size, out) == entry.size && (!pad || fwrite(&padding[0], 1, pad, out) == pad);
+        offset += entry.size + pad;
+    }
+    fclose(trace);
+
+    std::sort(index.begin(), index.end(), [](const PackEntry& a, const PackEntry& b) { return a.key < b.key; });
+
+    header.files = (uint32)index.size();
+    header.indexOffset = offset;
+    if (ok && !index.empty())
+        ok = fwrite(&index[0], sizeof(PackEntry), index.size(), out) == index.size();
+
+    // the archives the files were resolved from, in priority order, checked again by open()
+    header.archives = (uint32)gOpenArchives.size();
+    for (ArchiveSet::iterator i = gOpenArchives.begin(); ok && i != gOpenArchives.end(); ++i)
+    {
+        PackArchive archive;
+        if (fingerprint(*i, archive))
+            ok = fwrite(&archive, sizeof(archive), 1, out) == 1;
+        else
+        {
+            printf("Could not stat archive '%s'\n", (*i)->filename.c_str());
+            ok = false;
+        }
+    }
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1;
+    ok = (fclose(out) == 0) && ok;
+
+    printf("Packed %u files (%llu MB) into %s, %llu listed files not found\n", header.files,
+        (unsigned long long)(offset >> 20), packFile, (unsigned long long)missing);
+    if (!ok)
+        printf("Writing pack '%s' failed\n", packFile);
+    return ok;
+}
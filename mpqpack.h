@@ -0,0 +1,88 @@
+#ifndef MPQPACK_H
+#define MPQPACK_H
+
+#include "mpq_libmpq.h"
+#include <stddef.h>
+#include <memory>
+
+// Read-only mapping of a whole file.
+class MappedFile
+{
+        const char* data;
+        size_t size;
+        void* mapping;      // file mapping handle on windows
+
+        // disable copying
+        MappedFile(const MappedFile&) = delete;
+        void operator=(const MappedFile&) = delete;
+
+    public:
+        MappedFile() : data(0), size(0), mapping(0) {}
+        ~MappedFile() { close(); }
+
+        bool open(const char* filename);
+        void close();
+        bool isOpen() const { return data != 0; }
+        const char* getData() const { return data; }
+        size_t getSize() const { return size; }
+};
+
+// Flat pack of already decompressed files, written by repack() from the open archives.
+//
+// layout: PackHeader, file data at PACK_ALIGN boundaries in trace order, then
+// PackEntry[files] sorted by key (MPQIndex::key of the file name), then PackArchive[archives]
+// in patch priority order. A pack is only used with the same archives it was written from.
+class MPQPack
+{
+    public:
+        enum
+        {
+            PACK_MAGIC = 0x50564D57,    // 'WMVP'
+            PACK_VERSION = 2,
+            PACK_ALIGN = 4096
+        };
+
+        struct PackHeader
+        {
+            uint32 magic;
+            uint32 version;
+            uint32 files;
+            uint32 align;
+            uint64 indexOffset;
+            uint32 archives;
+            uint32 reserved;
+        };
+
+        struct PackEntry
+        {
+            uint64 key;
+            uint64 offset;
+            uint64 size;
+        };
+
+        // file name (without directory), size and modification time of an archive
+        struct PackArchive
+        {
+            char name[48];
+            uint64 size;
+            uint64 mtime;
+        };
+
+        static bool open(const char* filename);
+        static void close();
+        static bool isOpen() { return file && file->isOpen(); }
+        // views keep the mapping alive, so close() does not invalidate files still in use
+        static bool find(const char* filename, MPQView& view);
+
+        // writes every file named in the trace, resolved through the open archives, into a new pack
+        static bool repack(const char* traceFile, const char* packFile);
+
+    private:
+        static bool fingerprint(const MPQArchive* archive, PackArchive& result);
+
+        static std::shared_ptr<MappedFile> file;
+        static const PackEntry* entries;
+        static uint32 files;
+};
+
+#endif
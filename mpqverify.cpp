@@ -0,0 +1,124 @@
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include "mpqverify.h"
+#include "threadpool.h"
+
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+string MPQVerify::fileName(MPQArchive* archive, uint32 filenum)
+{
+    // only needed for bad files, so the listfile is searched instead of kept around
+    vector<string> names;
+    archive->GetFileListTo(names);
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        uint32 number;
+        if (libmpq__file_number(archive->mpq_a, names[i].c_str(), &number) == 0 && number == filenum)
+            return names[i];
+    }
+
+    char name[32];
+    sprintf(name, "file #%u", filenum);
+    return name;
+}
+
+bool MPQVerify::run(unsigned threads)
+{
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    struct Item
+    {
+        MPQArchive* archive;
+        uint32 filenum;
+    };
+    struct Failure
+    {
+        Item item;
+        int error;
+    };
+
+    vector<Item> items;
+    uint64 totalBytes = 0;
+    for (ArchiveSet::iterator i = gOpenArchives.begin(); i != gOpenArchives.end(); ++i)
+    {
+        uint32 files;
+        libmpq__archive_files((*i)->mpq_a, &files);
+        for (uint32 f = 0; f < files; ++f)
+        {
+            libmpq__off_t size;
+            libmpq__file_unpacked_size((*i)->mpq_a, f, &size);
+            totalBytes += size;
+            Item item = { *i, f };
+            items.push_back(item);
+        }
+    }
+
+    printf("Verifying %u files (%llu MB) in %u archives on %u threads\n", (unsigned)items.size(),
+        (unsigned long long)(totalBytes >> 20), (unsigned)gOpenArchives.size(), threads);
+
+    std::atomic<size_t> next(0), done(0);
+    std::atomic<uint64> bytes(0), packedBytes(0), checked(0);
+    std::mutex lock;
+    std::condition_variable finished;
+    vector<Failure> failures;
+
+    // workers pull the next file until the list is exhausted
+    std::function<void()> work = [&]()
+    {
+        for (size_t i; (i = next++) < items.size(); )
+        {
+            libmpq__off_t size = 0, packed = 0;
+            libmpq__file_unpacked_size(items[i].archive->mpq_a, items[i].filenum, &size);
+            libmpq__file_packed_size(items[i].archive->mpq_a, items[i].filenum, &packed);
+
+            uint32 sums = 0;
+            int result = libmpq__file_verify(items[i].archive->mpq_a, items[i].filenum, &sums);
+            bytes += size;
+            packedBytes += packed;
+            if (sums)
+                ++checked;
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (result)
+            {
+                Failure failure = { items[i], result };
+                failures.push_back(failure);
+            }
+            if (++done == items.size())
+                finished.notify_all();
+        }
+    };
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (unsigned t = 0; t < threads; ++t)
+            pool.post(work);
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (!finished.wait_for(guard, std::chrono::seconds(1), [&]() { return done == items.size(); }))
+        {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            printf("  %u/%u files, %llu MB, %.1f MB/s, %u bad\n", (unsigned)done, (unsigned)items.size(),
+                (unsigned long long)(bytes >> 20), (bytes / 1048576.0) / seconds, (unsigned)failures.size());
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (size_t i = 0; i < failures.size(); ++i)
+    {
+        const Failure& f = failures[i];
+        printf("  %s: %s in %s\n", f.error == LIBMPQ_ERROR_CHECKSUM ? "checksum mismatch" : "read error",
+            fileName(f.item.archive, f.item.filenum).c_str(), f.item.archive->filename.c_str());
+    }
+
+    printf("Verified %u files in %.1f s: %llu checked against (attributes), %u bad, %.1f MB/s unpacked, %.1f MB/s packed\n",
+        (unsigned)items.size(), seconds, (unsigned long long)checked, (unsigned)failures.size(),
+        seconds > 0 ? (bytes / 1048576.0) / seconds : 0.0, seconds > 0 ? (packedBytes / 1048576.0) / seconds : 0.0);
+    return failures.empty();
+}
@@ -0,0 +1,19 @@
+#ifndef MPQVERIFY_H
+#define MPQVERIFY_H
+
+#include "mpq_libmpq.h"
+
+// Integrity check of the open archives against the CRC32/MD5 entries of their (attributes).
+// Every file is read through libmpq's sector reader on all cores, so a run is also a
+// decompression stress test of the whole client data.
+class MPQVerify
+{
+    public:
+        // 0 threads uses one per core; prints progress, every bad file and the throughput
+        static bool run(unsigned threads);
+
+    private:
+        static string fileName(MPQArchive* archive, uint32 filenum);
+};
+
+#endif
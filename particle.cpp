@@ -395,7 +395,7 @@ void RibbonEmitter::init(MPQFile &f, ModelRibbonEmitterDef &mta, int *globals)
 	below.init(mta.below, f, globals);
 
 	parent = model->bones + mta.bone;
-	int *texlist = (int*)(f.getBuffer() + mta.ofsTextures);
+	int *texlist = (int*)(f.getConstBuffer() + mta.ofsTextures);
 	// just use the first texture for now; most models I've checked only had one
 	texture = model->textures[texlist[0]];
 
@@ -39,6 +39,7 @@ public:
 
 	void bind();
 	void unbind();
+	bool valid() { return fragment != 0; }
 };
 
 extern ShaderPair *terrainShaders[4], *wmoShader, *waterShaders[1];
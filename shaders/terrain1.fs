@@ -5,7 +5,8 @@ OPTION ARB_fog_linear;
 #Declarations
 TEMP col;
 TEMP specular;
-TEMP blend;
+TEMP shadow;
+TEMP coord3;
 
 ATTRIB tex0 = fragment.texcoord[0];
 ATTRIB tex1 = fragment.texcoord[1];
@@ -13,17 +14,28 @@ ATTRIB diff_color = fragment.color.primary;
 ATTRIB spec_color = fragment.color.secondary;
 PARAM shadow_col = program.local[0];
 
+#texture[1] holds the alpha maps of layers 1-3 and the shadow map as 64x64 strips,
+#mapped as in MapChunk::selectStrip; World::drawShaderChunks sets the constants
+PARAM strip_scale = program.local[1];
+PARAM strip_offset = program.local[2];
+PARAM strip_next = program.local[3];
+
 OUTPUT out = result.color;
 
+#strip coordinates first and every fetch into its own temp, so all fetches are one indirection
+MAD coord3, tex1, strip_scale, strip_offset;
+MAD coord3, strip_next, 3, coord3;
+
 #fetch textures
 TEX col, tex0, texture[0], 2D;
-TEX blend, tex1, texture[1], 2D;
+TEX shadow, coord3, texture[1], 2D;
+
 #specular
 MUL specular, spec_color, col.w;
 MAD col, col, diff_color, specular;
 
 #shadow
-LRP out, blend.a, shadow_col, col;
+LRP out, shadow.a, shadow_col, col;
 
 #fix alpha (shadow_col.a = 1)
 MOV out.a, shadow_col.a;
@@ -4,9 +4,12 @@ OPTION ARB_fog_linear;
 
 #Declarations
 TEMP col;
-TEMP layer;
-TEMP blend;
-ALIAS specular=layer;
+TEMP specular;
+TEMP shadow;
+TEMP layer1;
+TEMP alpha1;
+TEMP coord0;
+TEMP coord3;
 
 ATTRIB tex0 = fragment.texcoord[0];
 ATTRIB tex1 = fragment.texcoord[1];
@@ -14,22 +17,33 @@ ATTRIB diff_color = fragment.color.primary;
 ATTRIB spec_color = fragment.color.secondary;
 PARAM shadow_col = program.local[0];
 
+#texture[1] holds the alpha maps of layers 1-3 and the shadow map as 64x64 strips,
+#mapped as in MapChunk::selectStrip; World::drawShaderChunks sets the constants
+PARAM strip_scale = program.local[1];
+PARAM strip_offset = program.local[2];
+PARAM strip_next = program.local[3];
+
 OUTPUT out = result.color;
 
+#strip coordinates first and every fetch into its own temp, so all fetches are one indirection
+MAD coord0, tex1, strip_scale, strip_offset;
+MAD coord3, strip_next, 3, coord0;
+
 #fetch textures
 TEX col, tex0, texture[0], 2D;
-TEX blend, tex1, texture[1], 2D;
+TEX layer1, tex0, texture[2], 2D;
+TEX alpha1, coord0, texture[1], 2D;
+TEX shadow, coord3, texture[1], 2D;
 
 #layer 1
-TEX layer, tex0, texture[2], 2D;
-LRP col, blend.r, layer, col;
+LRP col, alpha1.a, layer1, col;
 
 #specular
 MUL specular, spec_color, col.w;
 MAD col, col, diff_color, specular;
 
 #shadow
-LRP out, blend.a, shadow_col, col;
+LRP out, shadow.a, shadow_col, col;
 
 #fix alpha (shadow_col.a = 1)
 MOV out.a, shadow_col.a;
@@ -288,6 +288,8 @@ bool Skies::drawSky(const Vec3D &pos)
 		glScalef(sc,sc,sc);
 		glEnable(GL_TEXTURE_2D);
 		stars->trans = ni;
+		// drawn around the camera, so always at full detail
+		stars->touchTextures(0);
         stars->draw();
 	}
 
@@ -29,6 +29,7 @@ Test::Test(World *w, float ah0, float av0): world(w), ah(ah0), av(av0)
 	look = false;
 	mapmode = false;
 	hud = true;
+	mpqstats = false;
 
 	world->thirdperson = false;
 	world->lighting = true;
@@ -38,6 +39,7 @@ Test::Test(World *w, float ah0, float av0): world(w), ah(ah0), av(av0)
 	world->drawwmo = true;
 	world->drawhighres = true;
 	world->drawfog = true; // should this be on or off by default..? :(
+	world->useshaders = true;
 
 	// in the wow client, fog distance is stored in wtf\config.wtf as "farclip"
 	// minimum is 357, maximum is 777
@@ -180,6 +182,24 @@ void Test::display(float t, float dt)
 			f16->print(5, video.yres - 22, "XYZ: (%.0f, %.0f, %.0f)", xyzPos.x, xyzPos.y, xyzPos.z);
 		}
 
+		if (mpqstats) {
+			// MPQ telemetry below the area names
+			vector<string> lines;
+			MPQStats::summary(lines);
+			for (size_t i = 0; i < lines.size(); i++)
+				f16->print(5, 70 + 20 * (int)i, "%s", lines[i].c_str());
+			f16->print(5, 70 + 20 * (int)lines.size(), "Textures: %.1f MB, %.1f MB saved by recompression, %u pending",
+				video.textures.getTextureBytes() / 1048576.0, video.textures.getSavedBytes() / 1048576.0,
+				(unsigned)video.textures.pendingCount());
+			// share of adds served from the zombie pool instead of loaded again
+			unsigned int tr = video.textures.revivals, mr = world->modelmanager.revivals, wr = world->wmomanager.revivals;
+			f16->print(5, 90 + 20 * (int)lines.size(), "Revived: textures %.0f%%, models %.0f%%, WMOs %.0f%%",
+				tr ? 100.0 * tr / (tr + video.textures.loads) : 0.0, mr ? 100.0 * mr / (mr + world->modelmanager.loads) : 0.0,
+				wr ? 100.0 * wr / (wr + world->wmomanager.loads) : 0.0);
+			f16->print(5, 110 + 20 * (int)lines.size(), "Terrain: %u chunks, %u draw calls, %u texture binds (%s)",
+				world->terrainChunks, world->terrainDrawCalls, world->terrainBinds, world->shaderterrain ? "single pass" : "multipass");
+		}
+
 		if (world->loading) {
 			const char* loadstr = "Loading...";
 			const char* oobstr = "Out of bounds";
@@ -347,12 +367,30 @@ void Test::keypressed(SDL_KeyboardEvent *e)
 		if (e->keysym.sym == SDLK_F6) {
 			world->drawwmo = !world->drawwmo;
 		}
+		// MPQ telemetry overlay, counting starts when it is first shown
+		if (e->keysym.sym == SDLK_F7) {
+			mpqstats = !mpqstats;
+			if (mpqstats && !MPQStats::isEnabled())
+				MPQStats::enable(true);
+		}
+		// print the telemetry to the console
+		if (e->keysym.sym == SDLK_F8) {
+			MPQStats::dump();
+		}
+		// resident levels and bytes of every texture to the log
+		if (e->keysym.sym == SDLK_F9) {
+			video.textures.dump();
+		}
 		if (e->keysym.sym == SDLK_h) {
 			world->drawhighres = !world->drawhighres;
 		}
 		if (e->keysym.sym == SDLK_f) {
 			world->drawfog = !world->drawfog;
 		}
+		// single pass shader terrain against the multipass renderer
+		if (e->keysym.sym == SDLK_u) {
+			world->useshaders = !world->useshaders;
+		}
 
 		if (e->keysym.sym == SDLK_KP_PLUS || e->keysym.sym == SDLK_PLUS) {
 			world->fogdistance += 60.0f;
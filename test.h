@@ -15,6 +15,7 @@ class Test :public AppState
 	bool look;
 	bool mapmode;
 	bool hud;
+	bool mpqstats;
 
 	World *world;
 
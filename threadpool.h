@@ -0,0 +1,85 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <map>
+
+// Fixed set of worker threads fed from one queue; higher priorities run first,
+// jobs of the same priority in the order they were queued.
+class ThreadPool
+{
+    public:
+        explicit ThreadPool(unsigned threads) :
+            m_bStop(false)
+        {
+            if (threads == 0)
+                threads = 1;
+
+            for (unsigned i = 0; i < threads; ++i)
+                m_vWorkers.emplace_back(&ThreadPool::run, this);
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_bStop = true;
+            }
+            m_cond.notify_all();
+
+            for (size_t i = 0; i < m_vWorkers.size(); ++i)
+                m_vWorkers[i].join();
+        }
+
+        unsigned size() const { return (unsigned)m_vWorkers.size(); }
+
+        // Queue a job without waiting for it.
+        void post(std::function<void()> job, int priority = 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_qJobs.emplace(priority, std::move(job));
+            }
+            m_cond.notify_one();
+        }
+
+        // Jobs queued but not started yet.
+        size_t pending()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_qJobs.size();
+        }
+
+    private:
+        void run()
+        {
+            for (;;)
+            {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_cond.wait(lock, [this]() { return m_bStop || !m_qJobs.empty(); });
+
+                    if (m_bStop && m_qJobs.empty())
+                        return;
+
+                    job = std::move(m_qJobs.begin()->second);
+                    m_qJobs.erase(m_qJobs.begin());
+                }
+                job();
+            }
+        }
+
+        std::vector<std::thread> m_vWorkers;
+        std::multimap<int, std::function<void()>, std::greater<int>> m_qJobs;     // equal keys keep insertion order
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        bool m_bStop;
+};
+
+#endif
@@ -1,8 +1,14 @@
 #include "video.h"
 #include "shaders.h"
+#include "blp.h"
 #include "mpq.h"
 #include "wowmapview.h"
 
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+
 /////// EXTENSIONS
 
 #if defined(_WIN32) || defined(DEFINE_ARB_MULTITEX)
@@ -23,11 +29,19 @@ PFNGLMAPBUFFERARBPROC glMapBufferARB = NULL;
 PFNGLUNMAPBUFFERARBPROC glUnmapBufferARB = NULL;
 
 PFNGLDRAWRANGEELEMENTSPROC glDrawRangeElements = NULL;
+// sync
+PFNGLFENCESYNCPROC glFenceSync = NULL;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync = NULL;
+PFNGLDELETESYNCPROC glDeleteSync = NULL;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange = NULL;
 
 bool supportCompression = false;
 bool supportMultiTex = false;
 bool supportVBO = false;
 bool supportDrawRangeElements = false;
+bool supportPBO = false;
+bool supportSync = false;
+bool supportMapRange = false;
 
 ////// VIDEO CLASS
 
@@ -116,6 +130,8 @@ void Video::init(int xres, int yres, bool fullscreen)
 	}
 #endif
 
+	initShaders();
+
 	gLog("OpenGL initialization successful\n");
 }
 
@@ -191,6 +207,20 @@ void Video::initExtensions()
         glMapBufferARB = (PFNGLMAPBUFFERARBPROC) SDL_GL_GetProcAddress("glMapBufferARB");
         glUnmapBufferARB = (PFNGLUNMAPBUFFERARBPROC) SDL_GL_GetProcAddress("glUnmapBufferARB");
     } else supportVBO = false;
+
+    supportPBO = supportVBO && (isExtensionSupported("GL_ARB_pixel_buffer_object") || isExtensionSupported("GL_EXT_pixel_buffer_object"));
+
+    if (isExtensionSupported("GL_ARB_sync")) {
+        glFenceSync = (PFNGLFENCESYNCPROC) SDL_GL_GetProcAddress("glFenceSync");
+        glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC) SDL_GL_GetProcAddress("glClientWaitSync");
+        glDeleteSync = (PFNGLDELETESYNCPROC) SDL_GL_GetProcAddress("glDeleteSync");
+        supportSync = glFenceSync && glClientWaitSync && glDeleteSync;
+    } else supportSync = false;
+
+    if (isExtensionSupported("GL_ARB_map_buffer_range")) {
+        glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC) SDL_GL_GetProcAddress("glMapBufferRange");
+        supportMapRange = glMapBufferRange != NULL;
+    } else supportMapRange = false;
 }
 
 /*void Video::initExtensions()
@@ -248,6 +278,114 @@ void Video::set2D()
 //////// TEXTURE MANAGER
 
 
+bool decodeBLP(const char *data, size_t size, BLPImage &image)
+{
+	// header: magic, type, attributes, size, then the offsets and sizes of 16 mip levels
+	if (!data || size < 148)
+		return false;
+
+	const unsigned char *attr = (const unsigned char*)data + 8;
+	int w = *(const int*)(data + 12);
+	int h = *(const int*)(data + 16);
+	const int *offsets = (const int*)(data + 20);
+	const int *sizes = (const int*)(data + 84);
+	if (w <= 0 || h <= 0 || w > 4096 || h > 4096)
+		return false;
+
+	image.w = w;
+	image.h = h;
+	image.recompressed = false;
+	image.alphabits = attr[1];
+	image.levels.clear();
+
+	if (attr[0] == 2) {
+		// compressed
+		image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		int blocksize = 8;
+
+		// guesswork here :(
+		if (attr[1]==8) {
+			// dxt3 or 5, the alpha type is 7 for interpolated alpha
+			if (attr[2]==7) image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			else image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+
+			blocksize = 16;
+
+		} else {
+			if (!attr[3]) image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		}
+		image.compressed = supportCompression;
+
+		std::vector<unsigned char> buf;
+
+		// do every mipmap level
+		for (int i=0; i<16; i++) {
+			if (w==0) w = 1;
+			if (h==0) h = 1;
+			if (!offsets[i] || !sizes[i] || (size_t)offsets[i] >= size)
+				break;
+
+			// levels cut short by the end of the file are padded with zeros
+			int blocks = ((w+3)/4) * ((h+3)/4) * blocksize;
+			size_t avail = std::min(std::min((size_t)sizes[i], (size_t)blocks), size - offsets[i]);
+			buf.assign(blocks, 0);
+			memcpy(&buf[0], data + offsets[i], avail);
+
+			image.levels.push_back(BLPImage::Level());
+			BLPImage::Level &level = image.levels.back();
+			level.w = w;
+			level.h = h;
+			if (image.compressed) {
+				level.data.swap(buf);
+			} else {
+				level.data.resize(w*h*4);
+				decompressDXTC(image.format, w, h, blocks, &buf[0], &level.data[0]);
+			}
+			w >>= 1;
+			h >>= 1;
+		}
+		if (!image.compressed)
+			image.format = GL_RGBA8;
+	}
+	else if (attr[0]==1) {
+		// uncompressed
+		if (size < 148 + 1024)
+			return false;
+		const unsigned char *palette = (const unsigned char*)data + 148;
+		image.format = GL_RGBA8;
+		image.compressed = false;
+
+		int alphabits = attr[1];
+		std::vector<unsigned char> buf;
+
+		for (int i=0; i<16; i++) {
+			if (w==0) w = 1;
+			if (h==0) h = 1;
+			if (!offsets[i] || !sizes[i] || (size_t)offsets[i] >= size)
+				break;
+
+			// indices followed by the alpha bits, zero padded if the file is cut short
+			size_t need = w*h + (w*h*alphabits + 7) / 8;
+			size_t avail = std::min(std::min((size_t)sizes[i], need), size - offsets[i]);
+			buf.assign(need, 0);
+			memcpy(&buf[0], data + offsets[i], avail);
+
+			image.levels.push_back(BLPImage::Level());
+			BLPImage::Level &level = image.levels.back();
+			level.w = w;
+			level.h = h;
+			level.data.resize(w*h*4);
+
+			expandPalette(palette, alphabits, w, h, &buf[0], &level.data[0]);
+			w >>= 1;
+			h >>= 1;
+		}
+	}
+	else return false;
+
+	return !image.levels.empty();
+}
+
 GLuint TextureManager::add(std::string name)
 {
 	GLuint id;
@@ -256,159 +394,568 @@ GLuint TextureManager::add(std::string name)
 		items[id]->addref();
 		return id;
 	}
+	if (revive(name, id))
+		return id;
 	glGenTextures(1,&id);
 
 	Texture *tex = new Texture(name);
 	tex->id = id;
-	LoadBLP(id, tex);
-
 	do_add(name, id, tex);
 
+	if (!async) {
+		LoadBLP(id, tex);
+		return id;
+	}
+
+	// a grey texel stands in until the decoded levels are uploaded
+	static const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+	glBindTexture(GL_TEXTURE_2D, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+
+	// read and decode on an I/O thread, the result waits in the ready queue for uploadPending()
+	std::shared_ptr<Load> load = std::make_shared<Load>();
+	load->id = id;
+	load->tex = tex;
+	load->decoded = false;
+	pending[id] = load;
+	// the callback holds the load weakly, the request it sits in belongs to the load
+	std::weak_ptr<Load> weak = load;
+	// nearer requesters are read first, the priority is their distance in whole units
+	load->request = MPQFile::openAsync(name.c_str(), -(int)std::min(loadDistance, 1e9f), [this, weak](const MPQView &view) {
+		std::shared_ptr<Load> load = weak.lock();
+		if (!load)
+			return;
+		load->decoded = decode(view.data, view.size, load->image);
+		std::lock_guard<std::mutex> guard(readyLock);
+		ready.push_back(load);
+	});
 	return id;
 }
 
-void TextureManager::LoadBLP(GLuint id, Texture *tex)
+void TextureManager::uploadPending(float budgetMs)
 {
-	// load BLP texture
+	Uint32 start = SDL_GetTicks();
+	frameBytes = 0;
+	for (bool first = true; first || (SDL_GetTicks() - start < budgetMs && (!uploadBudget || frameBytes < uploadBudget)); first = false) {
+		std::shared_ptr<Load> load;
+		{
+			std::lock_guard<std::mutex> guard(readyLock);
+			if (ready.empty())
+				break;
+			load = ready.front();
+			ready.pop_front();
+		}
+
+		// deleted before its data arrived, or the id now belongs to another texture
+		std::map<GLuint, std::shared_ptr<Load> >::iterator it = pending.find(load->id);
+		if (it == pending.end() || it->second != load)
+			continue;
+		pending.erase(it);
+
+		if (load->decoded)
+			uploaded(load->id, load->tex, load->image);
+		else
+			failed(load->id, load->tex);
+	}
+}
+
+void TextureManager::failed(GLuint id, Texture *tex)
+{
+	// a white texel replaces the grey one, so the surface draws untextured like after a failed LoadBLP
+	static const unsigned char blank[4] = { 255, 255, 255, 255 };
 	glBindTexture(GL_TEXTURE_2D, id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, blank);
+	tex->id = 0;
+}
 
-	int offsets[16],sizes[16],w,h;
-	GLint format;
+void TextureManager::cancelPending()
+{
+	for (std::map<GLuint, std::shared_ptr<Load> >::iterator it = pending.begin(); it != pending.end(); ++it)
+		it->second->request.cancel();
+	pending.clear();
 
-	char attr[4];
+	std::lock_guard<std::mutex> guard(readyLock);
+	ready.clear();
+}
 
+void TextureManager::LoadBLP(GLuint id, Texture *tex)
+{
+	// load BLP texture
 	MPQFile f(tex->name.c_str());
-	if (f.isEof()) {
+	BLPImage image;
+	if (f.isEof() || !decode(f.getConstBuffer(), f.getSize(), image)) {
 		tex->id = 0;
 		return;
 	}
+	f.close();
 
-	f.seek(8);
-	f.read(attr,4);
-	f.read(&w,4);
-	f.read(&h,4);
-	f.read(offsets,4*16);
-	f.read(sizes,4*16);
+	uploaded(id, tex, image);
+}
 
-	tex->w = w;
-	tex->h = h;
+void TextureManager::uploaded(GLuint id, Texture *tex, BLPImage &image)
+{
+	if (!budget) {
+		upload(id, tex, image, 0);
+		return;
+	}
 
-	if (attr[0] == 2) {
-		// compressed
+	// kept for streaming, and sent up from the coarsest level no larger than startSize
+	tex->coarsest = (int)image.levels.size() - 1;
+	for (int i=0; i<(int)image.levels.size(); i++) {
+		if (image.levels[i].w <= startSize && image.levels[i].h <= startSize) {
+			tex->coarsest = i;
+			break;
+		}
+	}
+	tex->source = std::make_shared<BLPImage>();
+	tex->source->w = image.w;
+	tex->source->h = image.h;
+	tex->source->format = image.format;
+	tex->source->compressed = image.compressed;
+	tex->source->recompressed = image.recompressed;
+	tex->source->alphabits = image.alphabits;
+	tex->source->levels.swap(image.levels);
+	upload(id, tex, *tex->source, tex->coarsest);
+}
 
-        unsigned char *ucbuf;
-        if (!supportCompression) ucbuf = new unsigned char[w*h*4];
+void TextureManager::upload(GLuint id, Texture *tex, const BLPImage &image, int base)
+{
+	glBindTexture(GL_TEXTURE_2D, id);
 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-		int blocksize = 8;
+	tex->w = image.w;
+	tex->h = image.h;
+	tex->base = base;
+	textureBytes -= tex->bytes;
+	savedBytes -= tex->saved;
+	tex->bytes = tex->saved = 0;
+
+	// level base becomes GL level 0; texture coordinates are normalized, so nothing else notices
+	int count = (int)image.levels.size() - base;
+	size_t size = 0;
+	for (int i=0; i<count; i++)
+		size += image.levels[base+i].data.size();
+	frameBytes += size;
+
+	// the whole chain is copied into the ring in one piece, the levels then point at offsets into it
+	unsigned char *staged = ring.isOpen() ? ring.map(size) : 0;
+	if (staged) {
+		size_t offset = 0;
+		for (int i=0; i<count; i++) {
+			const std::vector<unsigned char> &data = image.levels[base+i].data;
+			memcpy(staged + offset, &data[0], data.size());
+			offset += data.size();
+		}
+		ring.unmap();
+	} else directUploads++;
+
+	size_t offset = staged ? ring.mappedOffset() : 0;
+	for (int i=0; i<count; i++) {
+		const BLPImage::Level &level = image.levels[base+i];
+		const void *pixels = staged ? (const void*)GL_BUFFER_OFFSET(offset) : (const void*)&level.data[0];
+		offset += level.data.size();
+		tex->bytes += level.data.size();
+		if (image.recompressed)
+			tex->saved += level.w * level.h * 4 - level.data.size();
+		if (image.compressed)
+			glCompressedTexImage2DARB(GL_TEXTURE_2D, i, image.format, level.w, level.h, 0, (GLsizei)level.data.size(), pixels);
+		else
+			glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, level.w, level.h, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	}
+	if (staged)
+		ring.release();
+	// levels left over from a finer upload are emptied so the driver frees them, and never sampled
+	for (int i=count; i<tex->levels; i++)
+		glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	tex->levels = count;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, count > 0 ? count - 1 : 0);
+
+	textureBytes += tex->bytes;
+	savedBytes += tex->saved;
+	if (textureBytes > peakBytes) {
+		peakBytes = textureBytes;
+		peakSaved = savedBytes;
+	}
 
-		// guesswork here :(
-		if (attr[1]==8) {
-			// dxt3 or 5
-			//if (attr[2]) format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-			//else format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+}
 
-			format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+void TextureManager::setUploadRing(size_t bytes, int count)
+{
+	ring.close();
+	if (bytes && count && !ring.init(bytes, count))
+		gLog("Pixel buffer objects not supported, textures are uploaded from client memory\n");
+}
 
-			blocksize = 16;
+void TextureManager::logUploads()
+{
+	gLog("Texture uploads: %u through the ring (slots reused %u times after their fence, %u times orphaned), %u direct\n",
+		ring.staged, ring.recycled, ring.orphaned, directUploads);
+}
 
-		} else {
-			if (!attr[3]) format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
-		}
+bool UploadRing::init(size_t bytes, int count)
+{
+	close();
+	if (!supportPBO || !supportMapRange || !bytes || count <= 0)
+		return false;
 
-        unsigned char *buf = new unsigned char[sizes[0]];
+	slotBytes = bytes;
+	slots.resize(count);
+	for (size_t i=0; i<slots.size(); i++) {
+		glGenBuffersARB(1, &slots[i].buffer);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, slots[i].buffer);
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, slotBytes, NULL, GL_STREAM_DRAW_ARB);
+		slots[i].fence = 0;
+		slots[i].used = false;
+	}
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	current = offset = mapped = 0;
+	return true;
+}
 
-		// do every mipmap level
-		for (int i=0; i<16; i++) {
-			if (w==0) w = 1;
-			if (h==0) h = 1;
-			if (offsets[i] && sizes[i]) {
-				f.seek(offsets[i]);
-				f.read(buf,sizes[i]);
+void UploadRing::close()
+{
+	for (size_t i=0; i<slots.size(); i++) {
+		if (slots[i].fence)
+			glDeleteSync(slots[i].fence);
+		glDeleteBuffersARB(1, &slots[i].buffer);
+	}
+	slots.clear();
+}
 
-				int size = ((w+3)/4) * ((h+3)/4) * blocksize;
+void UploadRing::next()
+{
+	// one fence covers every upload made from the slot being left
+	if (supportSync && slots[current].used)
+		slots[current].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	current = (current + 1) % slots.size();
+	offset = 0;
+
+	// a passed fence means the GPU is done with the slot, otherwise its storage is dropped
+	// and the driver hands out fresh memory rather than making the next map wait
+	Slot &slot = slots[current];
+	if (!slot.used)
+		return;
+	bool idle = false;
+	if (slot.fence) {
+		GLenum state = glClientWaitSync(slot.fence, 0, 0);
+		idle = state != GL_TIMEOUT_EXPIRED && state != GL_WAIT_FAILED;
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+	}
+	if (idle) {
+		recycled++;
+	} else {
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, slot.buffer);
+		glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, slotBytes, NULL, GL_STREAM_DRAW_ARB);
+		orphaned++;
+	}
+	slot.used = false;
+}
 
-                if (supportCompression) {
-                    glCompressedTexImage2DARB(GL_TEXTURE_2D, i, format, w, h, 0, size, buf);
-                } else {
-                    decompressDXTC(format, w, h, size, buf, ucbuf);
-                    glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, ucbuf);
-                }
+unsigned char *UploadRing::map(size_t size)
+{
+	if (size > slotBytes)
+		return 0;
 
-			} else break;
-			w >>= 1;
-			h >>= 1;
-		}
+	// uploads start on 64 byte boundaries, which also satisfies any unpack alignment
+	size_t start = (offset + 63) & ~(size_t)63;
+	if (start + size > slotBytes) {
+		next();
+		start = 0;
+	}
 
-		delete[] buf;
-        if (!supportCompression) delete[] ucbuf;
+	// the range was never handed to GL since the slot was last recycled, so nothing waits on it
+	Slot &slot = slots[current];
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, slot.buffer);
+	unsigned char *data = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, start, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!data) {
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+		return 0;
 	}
-	else if (attr[0]==1) {
-		// uncompressed
-		unsigned int pal[256];
-		f.read(pal,1024);
+	slot.used = true;
+	mapped = start;
+	offset = start + size;
+	return data;
+}
 
-		unsigned char *buf = new unsigned char[sizes[0]];
-		unsigned int *buf2 = new unsigned int[w*h];
-		unsigned int *p;
-		unsigned char *c, *a;
+void UploadRing::unmap()
+{
+	glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+}
 
-		int alphabits = attr[1];
-		bool hasalpha = alphabits!=0;
+void UploadRing::release()
+{
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	staged++;
+}
 
-		for (int i=0; i<16; i++) {
-			if (w==0) w = 1;
-			if (h==0) h = 1;
-			if (offsets[i] && sizes[i]) {
-				f.seek(offsets[i]);
-				f.read(buf,sizes[i]);
-
-				int cnt = 0;
-				p = buf2;
-				c = buf;
-				a = buf + w*h;
-				for (int y=0; y<h; y++) {
-					for (int x=0; x<w; x++) {
-						unsigned int k = pal[*c++];
-						k = ((k&0x00FF0000)>>16) | ((k&0x0000FF00)) | ((k& 0x000000FF)<<16);
-						int alpha;
-						if (hasalpha) {
-							if (alphabits == 8) {
-								alpha = (*a++);
-							} else if (alphabits == 1) {
-								alpha = (*a & (1 << cnt++)) ? 0xff : 0;
-								if (cnt == 8) {
-									cnt = 0;
-									a++;
-								}
-							}
-						} else alpha = 0xff;
-
-						k |= alpha << 24;
-						*p++ = k;
-					}
-				}
+void TextureManager::setBudget(size_t bytes, int start, float distance)
+{
+	budget = bytes;
+	startSize = start;
+	streamDistance = distance;
+}
 
-				glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, buf2);
+void TextureManager::updateResidency(float budgetMs)
+{
+	if (!budget)
+		return;
+	Uint32 start = SDL_GetTicks();
 
-			} else break;
-			w >>= 1;
-			h >>= 1;
+	struct Candidate {
+		Texture *tex;
+		int want;
+		float distance;
+		bool operator<(const Candidate &c) const { return distance < c.distance; }
+	};
+	std::vector<Candidate> candidates;
+	for (std::map<GLuint, ManagedItem*>::iterator it = items.begin(); it != items.end(); ++it) {
+		Texture *tex = (Texture*)it->second;
+		if (!tex->source)
+			continue;
+
+		// textures not drawn for about a second only need their coarsest level
+		Candidate c = { tex, tex->coarsest, 1e30f };
+		if (tex->lastUse && frame - tex->lastUse < 60) {
+			c.distance = tex->distance;
+			float limit = streamDistance;
+			for (c.want = 0; c.want < tex->coarsest && c.distance > limit; c.want++)
+				limit *= 2;
+		}
+		candidates.push_back(c);
+	}
+
+	// over budget: the farthest give up what they do not need, then a level each until it fits;
+	// every new base is settled before anything is sent, so each texture is uploaded once
+	if (textureBytes > budget) {
+		std::sort(candidates.rbegin(), candidates.rend());
+		std::vector<int> target(candidates.size());
+		size_t projected = textureBytes;
+		for (size_t i=0; i<candidates.size(); i++) {
+			Texture *tex = candidates[i].tex;
+			for (target[i] = tex->base; projected > budget && target[i] < candidates[i].want; target[i]++)
+				projected -= tex->source->levels[target[i]].data.size();
+		}
+		for (bool dropped = true; dropped && projected > budget; ) {
+			dropped = false;
+			for (size_t i=0; i<candidates.size() && projected > budget; i++) {
+				Texture *tex = candidates[i].tex;
+				if (target[i] < tex->coarsest) {
+					projected -= tex->source->levels[target[i]++].data.size();
+					dropped = true;
+				}
+			}
 		}
 
-		delete[] buf2;
-		delete[] buf;
+		// within the same budgets as the streaming below, the rest is dropped on later frames
+		bool first = true;
+		for (size_t i=0; i<candidates.size(); i++) {
+			Texture *tex = candidates[i].tex;
+			if (target[i] == tex->base)
+				continue;
+			if (!first && (SDL_GetTicks() - start >= budgetMs || (uploadBudget && frameBytes >= uploadBudget)))
+				break;
+			upload(tex->id, tex, *tex->source, target[i]);
+			first = false;
+		}
 	}
 
-	f.close();
+	// nearest first, each as fine as it wants and the budget allows
+	std::sort(candidates.begin(), candidates.end());
+	for (size_t i=0; i<candidates.size(); i++) {
+		if (SDL_GetTicks() - start >= budgetMs || (uploadBudget && frameBytes >= uploadBudget))
+			break;
+		Texture *tex = candidates[i].tex;
+		int level = tex->base;
+		size_t extra = 0;
+		while (level > candidates[i].want && textureBytes + extra + tex->source->levels[level-1].data.size() <= budget)
+			extra += tex->source->levels[--level].data.size();
+		if (level < tex->base)
+			upload(tex->id, tex, *tex->source, level);
+	}
 
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+	frame++;
+}
+
+void TextureManager::dump()
+{
+	std::vector<std::pair<size_t, Texture*> > list;
+	for (std::map<GLuint, ManagedItem*>::iterator it = items.begin(); it != items.end(); ++it)
+		list.push_back(std::make_pair(((Texture*)it->second)->bytes, (Texture*)it->second));
+	std::sort(list.rbegin(), list.rend());
+
+	gLog("Textures: %u, %.1f MB resident, budget %.1f MB\n", (unsigned)list.size(), textureBytes / 1048576.0, budget / 1048576.0);
+
+	// what recompression saves on the loaded set, e.g. the 3x3 tiles around the camera
+	unsigned int recompressed = 0;
+	for (size_t i=0; i<list.size(); i++)
+		if (list[i].second->saved)
+			recompressed++;
+	gLog("Recompressed: %u textures, %.1f MB saved, %.1f MB as RGBA8 (%.0f%% less), peak %.1f MB with %.1f MB saved\n",
+		recompressed, savedBytes / 1048576.0, (textureBytes + savedBytes) / 1048576.0,
+		textureBytes + savedBytes ? 100.0 * savedBytes / (textureBytes + savedBytes) : 0.0,
+		peakBytes / 1048576.0, peakSaved / 1048576.0);
+	for (size_t i=0; i<list.size(); i++) {
+		Texture *tex = list[i].second;
+		int levels = tex->source ? (int)tex->source->levels.size() : 0;
+		gLog("%8u KB %4dx%-4d level %d/%d %8.0f  %s\n", (unsigned)(tex->bytes >> 10), tex->w, tex->h, tex->base, levels,
+			tex->lastUse && frame - tex->lastUse < 60 ? tex->distance : -1.0f, tex->name.c_str());
+	}
+}
+
+void TextureManager::setRecompression(bool on, const char *directory)
+{
+	recompress = on;
+	cacheDir = directory ? directory : "";
+	if (!cacheDir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(cacheDir, ec);
+	}
+}
+
+bool TextureManager::decode(const char *data, size_t size, BLPImage &image)
+{
+	// only palettized textures are worth it, and only where the driver takes S3TC
+	if (!recompress || !supportCompression || !data || size < 148 || data[8] != 1)
+		return decodeBLP(data, size, image);
+
+	// keyed by the contents, so a patched texture is encoded again
+	std::string path;
+	if (!cacheDir.empty()) {
+		unsigned long long hash = 14695981039346656037ULL;
+		for (size_t i=0; i<size; i++)
+			hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+		char name[32];
+		sprintf(name, "%016llx.dxt", hash);
+		path = cacheDir + "/" + name;
+		if (loadCached(path, image))
+			return true;
+	}
+
+	if (!decodeBLP(data, size, image))
+		return false;
+
+	image.format = image.alphabits ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	int blocksize = image.alphabits ? 16 : 8;
+	std::vector<unsigned char> packed;
+	for (size_t i=0; i<image.levels.size(); i++) {
+		BLPImage::Level &level = image.levels[i];
+		packed.resize(((level.w+3)/4) * ((level.h+3)/4) * blocksize);
+		compressDXTC(image.format, level.w, level.h, &level.data[0], &packed[0]);
+		level.data.swap(packed);
+	}
+	image.compressed = true;
+	image.recompressed = true;
+
+	if (!path.empty())
+		saveCached(path, image);
+	return true;
+}
+
+// cache file: "BLPD", version, encoder version, w, h, format, level count, then w, h, size and data of each level
+struct BLPCacheHeader {
+	char magic[4];
+	int version, encoder, w, h, format, levels;
+};
+
+bool TextureManager::loadCached(const std::string &path, BLPImage &image)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+
+	// only the two formats the encoder writes are taken, anything else is a stale or foreign file
+	BLPCacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, f) == 1 && !memcmp(header.magic, "BLPD", 4) && header.version == 2
+		&& header.encoder == DXTC_ENCODER_VERSION && header.levels > 0 && header.levels <= 16
+		&& (header.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+	if (!ok) {
+		fclose(f);
+		return false;
+	}
+	int blocksize = header.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 16 : 8;
+	image.levels.clear();
+	for (int i=0; ok && i<header.levels; i++) {
+		int dims[3];
+		ok = fread(dims, sizeof(dims), 1, f) == 1 && dims[0] > 0 && dims[1] > 0 && dims[0] <= 4096 && dims[1] <= 4096
+			&& dims[2] == ((dims[0]+3)/4) * ((dims[1]+3)/4) * blocksize;
+		if (!ok)
+			break;
+		image.levels.push_back(BLPImage::Level());
+		BLPImage::Level &level = image.levels.back();
+		level.w = dims[0];
+		level.h = dims[1];
+		level.data.resize(dims[2]);
+		ok = fread(&level.data[0], dims[2], 1, f) == 1;
+	}
+	fclose(f);
+	if (!ok)
+		return false;
+
+	image.w = header.w;
+	image.h = header.h;
+	image.format = header.format;
+	image.compressed = true;
+	image.recompressed = true;
+	return true;
 }
 
+void TextureManager::saveCached(const std::string &path, const BLPImage &image)
+{
+	// written aside and renamed, so a reader never sees half a file
+	char suffix[32];
+	sprintf(suffix, ".%u.tmp", (unsigned)std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::string temp = path + suffix;
+	FILE *f = fopen(temp.c_str(), "wb");
+	if (!f)
+		return;
+
+	BLPCacheHeader header = { { 'B', 'L', 'P', 'D' }, 2, DXTC_ENCODER_VERSION, image.w, image.h, image.format, (int)image.levels.size() };
+	bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+	for (size_t i=0; ok && i<image.levels.size(); i++) {
+		const BLPImage::Level &level = image.levels[i];
+		int dims[3] = { level.w, level.h, (int)level.data.size() };
+		ok = fwrite(dims, sizeof(dims), 1, f) == 1 && fwrite(&level.data[0], level.data.size(), 1, f) == 1;
+	}
+	ok = fclose(f) == 0 && ok;
 
-void TextureManager::doDelete(GLuint id)
+	std::error_code ec;
+	if (ok)
+		std::filesystem::rename(temp, path, ec);
+	if (!ok || ec)
+		std::filesystem::remove(temp, ec);
+}
+
+bool TextureManager::doRelease(GLuint id, ManagedItem *item)
+{
+	// still loading: its weight is unknown until the upload, and the load is cheaper to redo
+	if (pending.find(id) != pending.end())
+		return false;
+
+	// only the coarsest level stays resident in the pool, so the budget goes to visible textures;
+	// a revived texture streams its finer levels back in through updateResidency
+	Texture *tex = (Texture*)item;
+	if (budget && tex->source && tex->base < tex->coarsest)
+		upload(id, tex, *tex->source, tex->coarsest);
+	return true;
+}
+
+void TextureManager::doDelete(GLuint id, ManagedItem *item)
 {
+	Texture *tex = (Texture*)item;
+	textureBytes -= tex->bytes;
+	savedBytes -= tex->saved;
+
+	// a load still in flight is dropped, if it has not started it is never read
+	std::map<GLuint, std::shared_ptr<Load> >::iterator it = pending.find(id);
+	if (it != pending.end()) {
+		it->second->request.cancel();
+		pending.erase(it);
+	}
 	glDeleteTextures(1, &id);
 }
 
@@ -509,72 +1056,3 @@ GLuint loadTGA(const char* filename, bool mipmaps)
 	return t;
 }
 
-struct Color {
-    unsigned char r, g, b;
-};
-
-void decompressDXTC(GLint format, int w, int h, size_t size, unsigned char *src, unsigned char *dest)
-{
-    // sort of copied from linghuye
-    int bsx = (w<4) ? w : 4;
-    int bsy = (h<4) ? h : 4;
-
-    for(int y=0; y<h; y += bsy) {
-        for(int x=0; x<w; x += bsx) {
-            unsigned long long alpha = 0;
-            unsigned int a0 = 0, a1 = 0;
-
-            if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)	{
-                alpha = *(unsigned long long*)src;
-                src += 8;
-            }
-
-            unsigned int c0 = *(unsigned short*)(src + 0);
-            unsigned int c1 = *(unsigned short*)(src + 2);
-            src += 4;
-
-            Color color[4];
-            color[0].b = (unsigned char) ((c0 >> 11) & 0x1f) << 3;
-            color[0].g = (unsigned char) ((c0 >>  5) & 0x3f) << 2;
-            color[0].r = (unsigned char) ((c0      ) & 0x1f) << 3;
-            color[1].b = (unsigned char) ((c1 >> 11) & 0x1f) << 3;
-            color[1].g = (unsigned char) ((c1 >>  5) & 0x3f) << 2;
-            color[1].r = (unsigned char) ((c1      ) & 0x1f) << 3;
-            if(c0 > c1) {
-                color[2].r = (color[0].r * 2 + color[1].r) / 3;
-                color[2].g = (color[0].g * 2 + color[1].g) / 3;
-                color[2].b = (color[0].b * 2 + color[1].b) / 3;
-                color[3].r = (color[0].r + color[1].r * 2) / 3;
-                color[3].g = (color[0].g + color[1].g * 2) / 3;
-                color[3].b = (color[0].b + color[1].b * 2) / 3;
-            } else {
-                color[2].r = (color[0].r + color[1].r) / 2;
-                color[2].g = (color[0].g + color[1].g) / 2;
-                color[2].b = (color[0].b + color[1].b) / 2;
-                color[3].r = 0;
-                color[3].g = 0;
-                color[3].b = 0;
-            }
-
-            for (int j=0; j<bsy; j++) {
-                unsigned int index = *src++;
-                unsigned char* dd = dest + (w*(y+j)+x)*4;
-                for (int i=0; i<bsx; i++) {
-                    *dd++ = color[index & 0x03].b;
-                    *dd++ = color[index & 0x03].g;
-                    *dd++ = color[index & 0x03].r;
-                    if (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)	{
-                        *dd++ = ((index & 0x03) == 3 && c0 <= c1) ? 0 : 255;
-                    }
-                    else if (format == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT)	{
-                        *dd++ = (unsigned char)(alpha & 0x0f) << 4;
-                        alpha >>= 4;
-                    }
-                    index >>= 2;
-                }
-            }
-        }
-    }
-}
-
-
@@ -13,6 +13,12 @@
 
 #include "manager.h"
 #include "font.h"
+#include "mpq.h"
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
 
 #define PI 3.14159265358f
 
@@ -42,32 +48,217 @@ extern PFNGLUNMAPBUFFERARBPROC glUnmapBufferARB;
 
 extern PFNGLDRAWRANGEELEMENTSPROC glDrawRangeElements;
 
+// sync objects (ARB_sync), newer than the glext.h shipped with SDL
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE	0x9117
+#define GL_TIMEOUT_EXPIRED				0x911B
+#define GL_WAIT_FAILED					0x911D
+typedef struct __GLsync *GLsync;
+typedef GLsync (APIENTRYP PFNGLFENCESYNCPROC) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRYP PFNGLCLIENTWAITSYNCPROC) (GLsync sync, GLbitfield flags, unsigned long long timeout);
+typedef void (APIENTRYP PFNGLDELETESYNCPROC) (GLsync sync);
+#endif
+extern PFNGLFENCESYNCPROC glFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+extern PFNGLDELETESYNCPROC glDeleteSync;
+
+// buffer ranges (ARB_map_buffer_range), to write into a buffer the GPU may still be reading
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT				0x0002
+#define GL_MAP_INVALIDATE_RANGE_BIT		0x0004
+#define GL_MAP_UNSYNCHRONIZED_BIT		0x0020
+typedef GLvoid* (APIENTRYP PFNGLMAPBUFFERRANGEPROC) (GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+#endif
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+
 #define GL_BUFFER_OFFSET(i) ((char *)(0) + (i))
 
 extern bool supportCompression;
 extern bool supportMultiTex;
 extern bool supportVBO;
 extern bool supportDrawRangeElements;
+extern bool supportPBO;
+extern bool supportSync;
+extern bool supportMapRange;
 
 ////////// TEXTURE MANAGER
 
+// BLP decoded to the data of every mip level, ready for glTexImage2D (format GL_RGBA8)
+// or glCompressedTexImage2DARB (one of the S3TC formats). Decoding needs no GL context.
+struct BLPImage {
+	struct Level {
+		int w, h;
+		std::vector<unsigned char> data;
+	};
+
+	int w, h;
+	GLint format;
+	bool compressed;
+	bool recompressed;		// palettized, encoded to S3TC after expansion
+	int alphabits;
+	std::vector<Level> levels;
+};
+
+bool decodeBLP(const char *data, size_t size, BLPImage &image);
+
 class Texture : public ManagedItem {
 public:
 	int w,h;
 	GLuint id;
+	size_t bytes, saved;		// texture memory of the resident levels, and what recompression saved of it
+
+	// with a residency budget the decoded levels stay in memory, GL holds those from base on
+	std::shared_ptr<BLPImage> source;
+	int base, coarsest;
+	int levels;					// GL levels holding storage, the placeholder's included
+	float distance;				// nearest use in frame lastUse, 0 if never drawn
+	unsigned int lastUse;
+
+	Texture(std::string name):ManagedItem(name), w(0), h(0), bytes(0), saved(0), base(0), coarsest(0), levels(1), distance(0), lastUse(0) {}
+
+	size_t memoryBytes() const
+	{
+		size_t total = bytes;
+		if (source) {
+			for (size_t i=0; i<source->levels.size(); i++)
+				total += source->levels[i].data.size();
+		}
+		return total;
+	}
 
-	Texture(std::string name):ManagedItem(name), w(0), h(0) {}
+};
 
+// Pixel buffer objects taken round robin to hand texture data to GL without the driver
+// copying it from client memory inside glTexImage2D. Uploads are packed one after another
+// into the current slot through unsynchronized range maps; when one no longer fits, the slot
+// is fenced and the next one taken. That one is reused as it is once its fence has passed,
+// one still in flight (or any, without ARB_sync) is orphaned so mapping never waits.
+class UploadRing {
+	struct Slot {
+		GLuint buffer;
+		GLsync fence;
+		bool used;
+	};
+	std::vector<Slot> slots;
+	size_t slotBytes;
+	size_t current, offset, mapped;
+
+	void next();
+
+public:
+	unsigned int staged, recycled, orphaned;
+
+	UploadRing() : slotBytes(0), current(0), offset(0), mapped(0), staged(0), recycled(0), orphaned(0) {}
+
+	// false without pixel buffer objects or buffer ranges; 0 slots closes the ring
+	bool init(size_t bytes, int count);
+	void close();
+	bool isOpen() { return !slots.empty(); }
+
+	// maps size bytes of the current slot and leaves it bound to GL_PIXEL_UNPACK_BUFFER,
+	// 0 if size is larger than a slot
+	unsigned char *map(size_t size);
+	// where the last map starts in its buffer, pixel pointers are offsets from it
+	size_t mappedOffset() { return mapped; }
+	// unmaps, the slot stays bound for the uploads
+	void unmap();
+	// after the uploads: unbinds the slot
+	void release();
 };
 
 class TextureManager : public Manager<GLuint> {
-	
+	// a texture between add() and its upload; ids are reused by GL, so uploads check
+	// that their load is still the one pending for the id
+	struct Load {
+		GLuint id;
+		Texture *tex;			// alive while the load is pending, doDelete drops it first
+		MPQRequest request;
+		BLPImage image;
+		bool decoded;
+	};
+
+	std::map<GLuint, std::shared_ptr<Load> > pending;		// render thread only
+	std::deque<std::shared_ptr<Load> > ready;				// decoded, filled by the I/O threads
+	std::mutex readyLock;
+	bool async;
+
+	// uploads go through the ring when it is open; uploadPending and updateResidency stop
+	// once a frame has sent uploadBudget bytes, after at least one texture
+	UploadRing ring;
+	size_t uploadBudget, frameBytes;
+	unsigned int directUploads;
+
+	// palettized textures go to DXT1/DXT5 before upload, the encoded levels are kept in
+	// cacheDir under a hash of the BLP so the encoder runs once per texture
+	bool recompress;
+	std::string cacheDir;
+	size_t textureBytes, savedBytes, peakBytes, peakSaved;
+
+	bool decode(const char *data, size_t size, BLPImage &image);
+	bool loadCached(const std::string &path, BLPImage &image);
+	void saveCached(const std::string &path, const BLPImage &image);
 	void LoadBLP(GLuint id, Texture *tex);
+	void upload(GLuint id, Texture *tex, const BLPImage &image, int base);
+	void uploaded(GLuint id, Texture *tex, BLPImage &image);
+	void failed(GLuint id, Texture *tex);
+
+	// residency: textures start at their coarsest level no larger than startSize, move to
+	// finer levels as their nearest use comes within streamDistance * 2^level, and fall back
+	// to coarser ones, farthest first, while the resident bytes exceed the budget
+	size_t budget;
+	int startSize;
+	float streamDistance;
+	unsigned int frame;
+	float loadDistance;
 
 public:
-	virtual GLuint add(std::string name);
-	void doDelete(GLuint id);
+	TextureManager() : async(true), uploadBudget(0), frameBytes(0), directUploads(0), recompress(false),
+		textureBytes(0), savedBytes(0), peakBytes(0), peakSaved(0), budget(0), startSize(64), streamDistance(64.0f), frame(1), loadDistance(0) {}
 
+	virtual GLuint add(std::string name);
+	void doDelete(GLuint id, ManagedItem *item);
+	bool doRelease(GLuint id, ManagedItem *item);
+
+	// off: add() reads, decodes and uploads before it returns
+	void setAsync(bool on) { async = on; }
+	// textures added from now on are read in order of this distance from the camera, 0 first
+	void setLoadDistance(float distance) { loadDistance = distance; }
+	// uploads decoded textures until the budget is used, at least one; call once per frame
+	void uploadPending(float budgetMs);
+	size_t pendingCount() { return pending.size(); }
+	// drops every load still queued on the I/O threads, before they are stopped
+	void cancelPending();
+
+	// only takes effect where S3TC is supported; an empty directory disables the cache
+	void setRecompression(bool on, const char *directory);
+	// slots of bytes each, 0 closes the ring; needs the GL context
+	void setUploadRing(size_t bytes, int count);
+	void setUploadBudget(size_t bytes) { uploadBudget = bytes; }
+	void logUploads();
+	size_t getTextureBytes() { return textureBytes; }
+	size_t getSavedBytes() { return savedBytes; }
+	size_t getPeakBytes() { return peakBytes; }
+	size_t getPeakSaved() { return peakSaved; }
+
+	// 0 bytes keeps every level of every texture resident, as before
+	void setBudget(size_t bytes, int start, float distance);
+	size_t getBudget() { return budget; }
+	// drawn this frame at the given distance from the camera; needs a budget
+	void touch(GLuint id, float distance)
+	{
+		if (!budget) return;
+		std::map<GLuint, ManagedItem*>::iterator it = items.find(id);
+		if (it == items.end()) return;
+		Texture *tex = (Texture*)it->second;
+		if (tex->lastUse != frame || distance < tex->distance) {
+			tex->lastUse = frame;
+			tex->distance = distance;
+		}
+	}
+	// streams finer levels in and drops them under pressure, within the time budget; once per frame
+	void updateResidency(float budgetMs);
+	// every texture with its size, resident levels and bytes, largest first
+	void dump();
 };
 
 ////////// VIDEO CLASS
@@ -102,7 +293,6 @@ public:
 extern Video video;
 
 GLuint loadTGA(const char *filename, bool mipmaps);
-void decompressDXTC(GLint format, int w, int h, size_t size, unsigned char *src, unsigned char *dest);
 bool isExtensionSupported(const char *search);
 
 
@@ -2,6 +2,8 @@
 #include "world.h"
 #include "liquid.h"
 
+#include <algorithm>
+
 
 using namespace std;
 
@@ -21,7 +23,7 @@ WMO::WMO(std::string name): ManagedItem(name)
 	float ff[3];
 
 	char *ddnames;
-	char *groupnames;
+	const char *groupnames;
 
 	skybox = 0;
 
@@ -87,7 +89,7 @@ WMO::WMO(std::string name): ManagedItem(name)
 			}
 		}
 		else if (!strcmp(fourcc,"MOGN")) {
-			groupnames = (char*)f.getPointer();
+			groupnames = f.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MOGI")) {
 			// group info - important information! ^_^
@@ -146,7 +148,7 @@ WMO::WMO(std::string name): ManagedItem(name)
 		}
 		else if (!strcmp(fourcc,"MOSB")) {
 			if (size>4) {
-				string path = f.getPointer();
+				string path = f.getConstPointer();
 				fixname(path);
 				if (path.length()) {
 					gLog("SKYBOX:\n");
@@ -177,7 +179,7 @@ WMO::WMO(std::string name): ManagedItem(name)
 		}
 		else if (!strcmp(fourcc,"MOPR")) {
 			int nn = (int)size / 8;
-			WMOPR *pr = (WMOPR*)f.getPointer();
+			WMOPR *pr = (WMOPR*)f.getConstPointer();
 			for (int i=0; i<nn; i++) {
 				prs.push_back(*pr++);
 			}
@@ -350,6 +352,8 @@ void WMO::drawSkybox()
 		glTranslatef(o.x, o.y, o.z);
 		const float sc = 2.0f;
 		glScalef(sc,sc,sc);
+		// drawn around the camera, so always at full detail
+		skybox->touchTextures(0);
         skybox->draw();
 		glPopMatrix();
 		gWorld->hadSky = true;
@@ -436,7 +440,7 @@ void WMOLight::setupOnce(GLint light, Vec3D dir, Vec3D lcol)
 
 
 
-void WMOGroup::init(WMO *wmo, MPQFile &f, int num, char *names)
+void WMOGroup::init(WMO *wmo, MPQFile &f, int num, const char *names)
 {
 	this->wmo = wmo;
 	this->num = num;
@@ -545,16 +549,16 @@ void WMOGroup::initDisplayList()
 		if (!strcmp(fourcc,"MOPY")) {
 			// materials per triangle
 			nTriangles = (int)size / 2;
-			materials = (unsigned short*)gf.getPointer();
+			materials = (unsigned short*)gf.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MOVI")) {
 			// indices
-			indices =  (unsigned short*)gf.getPointer();
+			indices =  (unsigned short*)gf.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MOVT")) {
 			nVertices = (int)size / 12;
 			// let's hope it's padded to 12 bytes, not 16...
-			vertices =  (Vec3D*)gf.getPointer();
+			vertices =  (Vec3D*)gf.getConstPointer();
 			vmin = Vec3D( 9999999.0f, 9999999.0f, 9999999.0f);
 			vmax = Vec3D(-9999999.0f,-9999999.0f,-9999999.0f);
 			rad = 0;
@@ -571,14 +575,14 @@ void WMOGroup::initDisplayList()
 			rad = (vmax-center).length();
 		}
 		else if (!strcmp(fourcc,"MONR")) {
-			normals =  (Vec3D*)gf.getPointer();
+			normals =  (Vec3D*)gf.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MOTV")) {
-			texcoords =  (Vec2D*)gf.getPointer();
+			texcoords =  (Vec2D*)gf.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MOLR")) {
 			nLR = (int)size / 2;
-			useLights =  (short*)gf.getPointer();
+			useLights =  (short*)gf.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MODR")) {
 			nDoodads = (int)size / 2;
@@ -587,7 +591,7 @@ void WMOGroup::initDisplayList()
 		}
 		else if (!strcmp(fourcc,"MOBA")) {
 			nBatches = (int)size / 24;
-			batches = (WMOBatch*)gf.getPointer();
+			batches = (WMOBatch*)gf.getConstPointer();
 			
 			/*
 			// batch logging
@@ -614,7 +618,7 @@ void WMOGroup::initDisplayList()
 		else if (!strcmp(fourcc,"MOCV")) {
 			//gLog("CV: %d\n", size);
 			hascv = true;
-			cv = (unsigned int*)gf.getPointer();
+			cv = (unsigned int*)gf.getConstPointer();
 		}
 		else if (!strcmp(fourcc,"MLIQ")) {
 			// liquids
@@ -658,6 +662,8 @@ void WMOGroup::initDisplayList()
 	for (int b=0; b<nBatches; b++) {
 		WMOBatch *batch = &batches[b];
 		WMOMaterial *mat = &wmo->mat[batch->texture];
+		if (std::find(textures.begin(), textures.end(), mat->tex) == textures.end())
+			textures.push_back(mat->tex);
 
         // setup texture
 		glBindTexture(GL_TEXTURE_2D, mat->tex);
@@ -769,6 +775,9 @@ void WMOGroup::draw(const Vec3D& ofs, const float rot)
 	float dist = (pos - gWorld->camera).length() - rad;
 	if (dist >= gWorld->culldistance) return;
 	visible = true;
+
+	for (size_t i=0; i<textures.size(); i++)
+		video.textures.touch(textures[i], dist);
 	
 	if (hascv) {
 		glDisable(GL_LIGHTING);
@@ -911,6 +920,14 @@ void WMOFog::setup()
 	}
 }
 
+size_t WMO::memoryBytes() const
+{
+	size_t total = 0;
+	for (int i=0; groups && i<nGroups; i++)
+		total += groups[i].memoryBytes();
+	return total;
+}
+
 int WMOManager::add(std::string name)
 {
 	int id;
@@ -920,6 +937,8 @@ int WMOManager::add(std::string name)
 		//gLog("Loading WMO %s [already loaded]\n",name.c_str());
 		return id;
 	}
+	if (revive(name, id))
+		return id;
 
 	// load new
 	WMO *wmo = new WMO(name);
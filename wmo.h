@@ -29,6 +29,7 @@ class WMOGroup {
 	int nDoodads;
 	short *ddr;
 	Liquid *lq;
+	std::vector<TextureID> textures;	// of the batches, for texture residency
 public:
 	Vec3D b1,b2;
 	Vec3D vmin, vmax;
@@ -40,13 +41,14 @@ public:
 
 	WMOGroup() : dl(0) {}
 	~WMOGroup();
-	void init(WMO *wmo, MPQFile &f, int num, char *names);
+	void init(WMO *wmo, MPQFile &f, int num, const char *names);
 	void initDisplayList();
 	void initLighting(int nLR, short *useLights);
 	void draw(const Vec3D& ofs, const float rot);
 	void drawLiquid();
 	void drawDoodads(int doodadset, const Vec3D& ofs, const float rot);
 	void setupFog();
+	size_t memoryBytes() const { return nVertices * (2 * sizeof(Vec3D) + 2 * sizeof(float)) + nTriangles * sizeof(short); }
 };
 
 struct WMOMaterial {
@@ -142,6 +144,7 @@ public:
 	void draw(int doodadset, const Vec3D& ofs, const float rot);
 	//void drawPortals();
 	void drawSkybox();
+	size_t memoryBytes() const;
 };
 
 
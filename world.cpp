@@ -1,5 +1,7 @@
 #include "world.h"
+#include "shaders.h"
 #include <cassert>
+#include <algorithm>
 
 using namespace std;
 
@@ -11,6 +13,9 @@ World::World(const char* name):basename(name)
 
 	gLog("\nLoading world %s\n", name);
 
+	modelmanager.setZombieBudget(gZombieBudget);
+	wmomanager.setZombieBudget(gZombieBudget);
+
 	for (int i=0; i<MAPTILECACHESIZE; i++) maptilecache[i] = 0;
 
 	autoheight = false;
@@ -44,6 +49,8 @@ void World::init()
 	loading = false;
 
 	drawfog = false;
+	useshaders = shaderterrain = false;
+	terrainChunks = terrainDrawCalls = terrainBinds = 0;
 
 	memset(maps,0,sizeof(maps));
 
@@ -108,7 +115,7 @@ void World::initMinimap()
 	char fn[256];
 	sprintf(fn,"World\\Maps\\%s\\%s.wdl", basename.c_str(), basename.c_str());
 
-	MPQFile f(fn);
+	MPQFile f(fn, true);
 	f.seek(0x14);
 	f.read(ofsbuf,64*64*4);
 
@@ -232,7 +239,7 @@ void World::initLowresTerrain()
 	Vec3D lowsub[16][16];
 	int ofsbuf[64][64];
 
-	MPQFile f(fn);
+	MPQFile f(fn, true);
 	f.seek(0x14);
 	f.read(ofsbuf,64*64*4);
 
@@ -469,6 +476,13 @@ World::~World()
 	if (mapstrip) delete[] mapstrip;
 	if (mapstrip2) delete[] mapstrip2;
 
+	gLog("Models: %u loaded, %u revived, %u evicted; WMOs: %u loaded, %u revived, %u evicted\n",
+		modelmanager.loads, modelmanager.revivals, modelmanager.evictions,
+		wmomanager.loads, wmomanager.revivals, wmomanager.evictions);
+	// WMOs release their doodads, so they go first
+	wmomanager.purgeZombies();
+	modelmanager.purgeZombies();
+
 	gLog("Unloaded world %s\n", basename.c_str());
 }
 
@@ -537,7 +551,11 @@ MapTile *World::loadTile(int x, int z)
 	char name[256];
 	sprintf(name,"World\\Maps\\%s\\%s_%d_%d.adt", basename.c_str(), basename.c_str(), x, z);
 
+	// everything the tile adds is read after the tiles nearer to the camera
+	float dx = (x + 0.5f) * TILESIZE - camera.x, dz = (z + 0.5f) * TILESIZE - camera.z;
+	video.textures.setLoadDistance(sqrtf(dx*dx + dz*dz));
 	maptilecache[firstnull] = new MapTile(x,z,name);
+	video.textures.setLoadDistance(0);
 	return maptilecache[firstnull];
 }
 
@@ -574,6 +592,66 @@ void myFakeLighting()
 }
 */
 
+// groups chunks by program, then by base texture and layers
+static bool chunkTextureOrder(const MapChunk *a, const MapChunk *b)
+{
+	if (a->nTextures != b->nTextures) return a->nTextures < b->nTextures;
+	for (int i=0; i<a->nTextures; i++) {
+		if (a->textures[i] != b->textures[i]) return a->textures[i] < b->textures[i];
+	}
+	return false;
+}
+
+void World::drawShaderChunks()
+{
+	if (shaderchunks.empty()) return;
+
+	// sorted, a texture unit is only rebound when the next chunk uses a different texture
+	sort(shaderchunks.begin(), shaderchunks.end(), chunkTextureOrder);
+
+	Vec3D shc = skies->colorSet[SHADOW_COLOR] * 0.3f;
+
+	// units: 0 base texture, 1 blend map, 2-4 layers 1-3
+	GLuint bound[5] = {0, 0, 0, 0, 0};
+	int program = 0;
+	for (size_t c=0; c<shaderchunks.size(); c++) {
+		MapChunk *chunk = shaderchunks[c];
+		if (chunk->nTextures != program) {
+			program = chunk->nTextures;
+			terrainShaders[program-1]->bind();
+			glProgramLocalParameter4fARB(GL_FRAGMENT_PROGRAM_ARB, 0, shc.x, shc.y, shc.z, 1);
+			// the blend map strips, mapped as the multipass renderer does
+			glProgramLocalParameter4fARB(GL_FRAGMENT_PROGRAM_ARB, 1, 1, stripScale, 0, 0);
+			glProgramLocalParameter4fARB(GL_FRAGMENT_PROGRAM_ARB, 2, 0, stripOffset, 0, 0);
+			glProgramLocalParameter4fARB(GL_FRAGMENT_PROGRAM_ARB, 3, 0, stripScale, 0, 0);
+		}
+		for (int i=0; i<chunk->nTextures; i++) {
+			int unit = i ? i+1 : 0;
+			if (bound[unit] != chunk->textures[i]) {
+				glActiveTextureARB(GL_TEXTURE0_ARB + unit);
+				glBindTexture(GL_TEXTURE_2D, chunk->textures[i]);
+				bound[unit] = chunk->textures[i];
+				terrainBinds++;
+			}
+		}
+		glActiveTextureARB(GL_TEXTURE1_ARB);
+		glBindTexture(GL_TEXTURE_2D, chunk->blendmap);
+		terrainBinds++;
+
+		chunk->drawSinglePass();
+	}
+	terrainShaders[program-1]->unbind();
+
+	for (int unit=2; unit<5; unit++) {
+		if (bound[unit]) {
+			glActiveTextureARB(GL_TEXTURE0_ARB + unit);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+	}
+	glActiveTextureARB(GL_TEXTURE1_ARB);
+	shaderchunks.clear();
+}
+
 void World::outdoorLighting()
 {
 	Vec4D black(0,0,0,0);
@@ -788,6 +866,11 @@ void World::draw()
 
 	glClientActiveTextureARB(GL_TEXTURE0_ARB);
 
+	terrainChunks = terrainDrawCalls = terrainBinds = 0;
+	shaderterrain = useshaders && supportShaders;
+	for (int i=0; i<4 && shaderterrain; i++)
+		shaderterrain = terrainShaders[i] && terrainShaders[i]->valid();
+
 	// height map w/ a zillion texture passes
 	if (drawterrain) {
 		for (int j=0; j<3; j++) {
@@ -796,6 +879,7 @@ void World::draw()
 				if (oktile(i,j) && current[j][i] != 0) current[j][i]->draw();
 			}
 		}
+		drawShaderChunks();
 	}
 
 	glActiveTextureARB(GL_TEXTURE1_ARB);
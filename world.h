@@ -45,6 +45,12 @@ public:
 
 	bool thirdperson,lighting,drawmodels,drawdoodads,drawterrain,drawwmo,loading,drawhighres,drawfog;
 	bool uselowlod;
+	// single pass terrain through the fragment programs; shaderterrain is set per frame
+	// when they are available, MapChunk::draw then queues chunks into shaderchunks
+	bool useshaders, shaderterrain;
+	std::vector<MapChunk*> shaderchunks;
+	// terrain statistics of the last frame
+	unsigned int terrainChunks, terrainDrawCalls, terrainBinds;
 
 	GLuint detailtexcoords, alphatexcoords;
 
@@ -76,6 +82,7 @@ public:
 	MapTile *loadTile(int x, int z);
 	void tick(float dt);
 	void draw();
+	void drawShaderChunks();
 
 	void outdoorLighting();
 	void outdoorLights(bool on);
@@ -18,9 +18,14 @@
 #include <cstdlib>
 #include <algorithm>
 #include <filesystem>
+#include <chrono>
 
 #include "mpq.h"
+#include "mpqpack.h"
+#include "mpqverify.h"
+#include "mpqloose.h"
 #include "video.h"
+#include "blp.h"
 #include "appstate.h"
 
 #include "test.h"
@@ -42,6 +47,7 @@ std::vector<AppState*> gStates;
 bool gPop = false;
 
 float gFPS;
+size_t gZombieBudget = 0;
 
 GLuint ftex;
 Font *f16, *f24, *f32;
@@ -124,7 +130,23 @@ int main(int argc, char *argv[])
     bool usePatch = true;
 
     const char *override_game_path = NULL;
+    const char *benchFile = NULL;
+    const char *stressList = NULL;
+    const char *compareList = NULL;
+    int stressThreads = 8;
+    const char *repackTrace = NULL;
+    const char *repackFile = NULL;
+    const char *packFile = NULL;
+    bool verify = false;
+    const char *extractDir = NULL;
+    const char *looseDir = NULL;
     int maxFps = 60;
+    int blpBench = 0;
+    bool recompress = false;
+    const char *texCacheDir = NULL;
+    int uploadRing = 0;
+    int ioThreads = 2;
+    float textureBudget = 4.0f;
 
     for (int i=1; i<argc; i++) {
         if (!strcmp(argv[i],"-gamepath")) {
@@ -168,13 +190,147 @@ int main(int argc, char *argv[])
         else if (!strcmp(argv[i],"-p")) usePatch = true;
         else if (!strcmp(argv[i],"-np")) usePatch = false;
         else if (!strcmp(argv[i],"-tbc")) expansion = 1;
+        else if (!strcmp(argv[i],"-mmap")) MPQArchive::openFlags |= LIBMPQ_OPEN_MMAP;
+        else if (!strcmp(argv[i],"-mpqcache"))
+        {
+            // decompressed file cache budget in megabytes
+            i++;
+            MPQCache::setBudget(uint64(std::max(0, atoi(argv[i]))) << 20);
+        }
+        else if (!strcmp(argv[i],"-mpqthreads"))
+        {
+            // decompression workers for files with many sectors
+            i++;
+            MPQFile::setDecompressThreads(std::max(0, atoi(argv[i])));
+        }
+        else if (!strcmp(argv[i],"-iothreads"))
+        {
+            // threads serving MPQFile::openAsync, 0 loads on the calling thread
+            i++;
+            ioThreads = std::max(0, atoi(argv[i]));
+        }
+        else if (!strcmp(argv[i],"-mpqstats"))
+        {
+            // collect MPQ telemetry from the start, it is dumped on exit
+            MPQStats::enable(true);
+        }
+        else if (!strcmp(argv[i],"-mpqbench"))
+        {
+            i++;
+            benchFile = argv[i];
+        }
+        else if (!strcmp(argv[i],"-mpqcompare"))
+        {
+            // file list (e.g. from -mpqtrace) read with the reference and the fast decoders and compared
+            i++;
+            compareList = argv[i];
+        }
+        else if (!strcmp(argv[i],"-mpqstress"))
+        {
+            // file list (e.g. from -mpqtrace) read by n threads at once and checked against a serial read
+            i++;
+            stressList = argv[i];
+            i++;
+            stressThreads = std::max(1, atoi(argv[i]));
+        }
+        else if (!strcmp(argv[i],"-tablecache"))
+        {
+            // keep decrypted archive tables in this directory between runs
+            i++;
+            std::error_code ec;
+            std::filesystem::create_directories(argv[i], ec);
+            libmpq__cache_dir(argv[i]);
+        }
+        else if (!strcmp(argv[i],"-mpqtrace"))
+        {
+            // record opened files for -repack
+            i++;
+            MPQFile::setTrace(argv[i]);
+        }
+        else if (!strcmp(argv[i],"-repack"))
+        {
+            // -repack <trace> <pack>: write the traced files into a pack and exit
+            repackTrace = argv[++i];
+            repackFile = argv[++i];
+        }
+        else if (!strcmp(argv[i],"-verify"))
+        {
+            // check every archive file against its (attributes) and exit
+            verify = true;
+        }
+        else if (!strcmp(argv[i],"-extract"))
+        {
+            // write all listed files below this directory and exit
+            i++;
+            extractDir = argv[i];
+        }
+        else if (!strcmp(argv[i],"-loose"))
+        {
+            // serve files found below this directory ahead of the pack and the archives
+            i++;
+            looseDir = argv[i];
+        }
+        else if (!strcmp(argv[i],"-pack"))
+        {
+            i++;
+            packFile = argv[i];
+        }
         else if (!strcmp(argv[i],"-fps"))
         {
             i++;
             maxFps = std::max(1, atoi(argv[i]));
         }
+        else if (!strcmp(argv[i],"-texbudget"))
+        {
+            // milliseconds per frame spent uploading textures decoded on the I/O threads
+            i++;
+            textureBudget = std::max(0.0f, (float)atof(argv[i]));
+        }
+        else if (!strcmp(argv[i],"-syncblp")) video.textures.setAsync(false);
+        else if (!strcmp(argv[i],"-recompress")) recompress = true;
+        else if (!strcmp(argv[i],"-texcache"))
+        {
+            // recompressed textures are kept in this directory between runs
+            i++;
+            texCacheDir = argv[i];
+            recompress = true;
+        }
+        else if (!strcmp(argv[i],"-texmem"))
+        {
+            // texture memory budget in MB, finer mip levels are streamed in by distance
+            i++;
+            video.textures.setBudget(size_t(std::max(0, atoi(argv[i]))) << 20, 64, 64.0f);
+        }
+        else if (!strcmp(argv[i],"-pbo"))
+        {
+            // size in MB of each of the 4 pixel buffer objects texture uploads are staged through
+            i++;
+            uploadRing = std::max(0, atoi(argv[i]));
+        }
+        else if (!strcmp(argv[i],"-uploadmb"))
+        {
+            // MB of texture data handed to GL per frame, on top of the time budget
+            i++;
+            video.textures.setUploadBudget(size_t(std::max(0, atoi(argv[i]))) << 20);
+        }
+        else if (!strcmp(argv[i],"-zombies"))
+        {
+            // MB of released textures, models and WMOs (each) kept for reuse by the next tiles
+            i++;
+            gZombieBudget = size_t(std::max(0, atoi(argv[i]))) << 20;
+            video.textures.setZombieBudget(gZombieBudget);
+        }
+        else if (!strcmp(argv[i],"-blpbench"))
+        {
+            // software texture decoders against their reference, no game data needed
+            i++;
+            blpBench = std::max(1, atoi(argv[i]));
+        }
     }
 
+    if (blpBench)
+        return benchmarkBLP(blpBench) ? 0 : 1;
+    video.textures.setRecompression(recompress, texCacheDir);
 
     if (override_game_path || gamePath != "./")
     {
@@ -195,6 +351,7 @@ int main(int argc, char *argv[])
     gLog(APP_TITLE " " APP_VERSION "\nGame path: %s\n", gamePath.c_str());
 
 
+    std::chrono::steady_clock::time_point openStart = std::chrono::steady_clock::now();
     std::vector<MPQArchive*> archives;
     char path[512];
     // TBC+ have archives in locale folders
@@ -260,6 +417,69 @@ int main(int argc, char *argv[])
         }
     }
 
+    // resolve patch priority once, MPQFile lookups use the index from here on
+    MPQIndex::build();
+
+    gLog("Opened %u archives in %.1f ms\n", (unsigned)gOpenArchives.size(),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - openStart).count());
+
+    if (repackFile) {
+        bool packed = MPQPack::repack(repackTrace, repackFile);
+        for (auto it = archives.begin(); it != archives.end(); ++it)
+            (*it)->close();
+        return packed ? 0 : 1;
+    }
+
+    if (verify) {
+        bool intact = MPQVerify::run(0);
+        for (auto it = archives.begin(); it != archives.end(); ++it)
+            (*it)->close();
+        return intact ? 0 : 1;
+    }
+
+    if (extractDir) {
+        bool extracted = MPQLoose::extract(extractDir, 0);
+        for (auto it = archives.begin(); it != archives.end(); ++it)
+            (*it)->close();
+        return extracted ? 0 : 1;
+    }
+
+    // files found in the pack are served from it, everything else still comes from the archives
+    if (packFile)
+        MPQPack::open(packFile);
+    if (looseDir)
+        MPQLoose::open(looseDir);
+
+    if (stressList) {
+        // concurrent reads from the same archives, no window
+        bool ok = MPQFile::stress(stressList, stressThreads, 4);
+        MPQFile::setDecompressThreads(0);
+        for (auto it = archives.begin(); it != archives.end(); ++it)
+            (*it)->close();
+        return ok ? 0 : 1;
+    }
+
+    if (benchFile) {
+        // decompression throughput only, no window
+        bool same = MPQFile::benchmark(benchFile, 20);
+        MPQFile::setDecompressThreads(0);
+        for (auto it = archives.begin(); it != archives.end(); ++it)
+            (*it)->close();
+        return same ? 0 : 1;
+    }
+
+    if (compareList) {
+        // reference against fast decoders, no window
+        bool same = MPQFile::compare(compareList);
+        MPQFile::setDecompressThreads(0);
+        for (auto it = archives.begin(); it != archives.end(); ++it)
+            (*it)->close();
+        return same ? 0 : 1;
+    }
+
+    // started once the index and pack are in place, they are only read from the I/O threads
+    MPQFile::setIOThreads(ioThreads);
+
     gLog("Opening Area DBC Files...\n");
     gAreaDB.open();
 
@@ -279,6 +499,9 @@ int main(int argc, char *argv[])
 #endif
     }
 
+    if (uploadRing)
+        video.textures.setUploadRing(size_t(uploadRing) << 20, 4);
+
     initFonts();
 
 
@@ -330,6 +553,9 @@ int main(int argc, char *argv[])
 
         as->tick(ftime, dt/1000.0f);
 
+        video.textures.uploadPending(textureBudget);
+        video.textures.updateResidency(textureBudget);
+
         as->display(ftime, dt/1000.0f);
 
         if (gPop) {
@@ -359,8 +585,36 @@ int main(int argc, char *argv[])
 
     deleteFonts();
 
+    gLog("Textures: %u loaded, %u revived, %u evicted from the zombie pool\n",
+        video.textures.loads, video.textures.revivals, video.textures.evictions);
+    video.textures.purgeZombies();
+    video.textures.logUploads();
+    video.textures.setUploadRing(0, 0);
+
     video.close();
 
+    if (MPQCache::getBudget())
+    {
+        MPQCache::Stats cs = MPQCache::getStats();
+        gLog("MPQ cache: %llu hits, %llu misses, %llu streamed past, %llu evictions, %llu files / %llu KB resident\n",
+            (unsigned long long)cs.hits, (unsigned long long)cs.misses, (unsigned long long)cs.bypasses, (unsigned long long)cs.evictions,
+            (unsigned long long)cs.files, (unsigned long long)(cs.bytes >> 10));
+    }
+    gLog("Textures: peak %.1f MB, %.1f MB of it saved by recompression\n",
+        video.textures.getPeakBytes() / 1048576.0, video.textures.getPeakSaved() / 1048576.0);
+    if (MPQStats::isEnabled())
+        MPQStats::dump();
+    // texture loads still queued look up the index and fill the cache, so the I/O threads
+    // stop before those are cleared; they may also hand sectors to the decompression pool
+    video.textures.cancelPending();
+    MPQFile::setIOThreads(0);
+    MPQCache::clear();
+    MPQDirectory::clear();
+    MPQIndex::clear();
+    MPQPack::close();
+    MPQLoose::close();
+    MPQFile::setDecompressThreads(0);
+    MPQFile::setTrace(NULL);
     for (auto it = archives.begin(); it != archives.end(); ++it) {
         (*it)->close();
     }
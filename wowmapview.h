@@ -20,6 +20,7 @@ extern bool gPop;
 extern Font *f16, *f24, *f32;
 
 extern float gFPS;
+extern size_t gZombieBudget;	// per manager, for items released by unloaded tiles
 
 float frand();
 float randfloat(float lower, float upper);